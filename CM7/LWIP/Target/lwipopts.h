@@ -119,6 +119,10 @@
 
 #define LWIP_POSIX_SOCKETS_IO_NAMES 0
 #define LWIP_COMPAT_SOCKETS 0
+/* The listening sockets of the TCP servers, TCP_SERVER_SLOTS clients and
+   one more, to turn away a client when all the slots are taken */
+#define MEMP_NUM_NETCONN 9
+#define MEMP_NUM_TCP_PCB 9
 /* USER CODE END 1 */
 
 #ifdef __cplusplus
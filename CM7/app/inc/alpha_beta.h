@@ -0,0 +1,61 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "seqlock.h"
+
+/**
+ * @class   alpha_beta
+ * @brief   alpha-beta observer of the position and velocity of an axis, fed
+ *          with the timestamped encoder counts.
+ * @details Between two measurements the position is predicted at constant
+ *          velocity. The measurement corrects the position by alpha times the
+ *          residual, and the velocity by beta times the residual over the
+ *          elapsed time. The estimate is published through a seqlock, so it
+ *          can be read at any time, and extrapolated to the time of the read,
+ *          without an SPI transfer.
+ *          Positions are in counts, velocities in counts/s and timestamps in
+ *          DWT cycles.
+ * @note    update() must be called from a single task, the encoders poller
+ */
+class alpha_beta {
+  public:
+    struct estimate {
+        float position;
+        float velocity;
+        uint32_t timestamp;
+    };
+
+    void update(int32_t counts, uint32_t timestamp);
+
+    /**
+     * @brief   starts again from the next measurement, e.g. after the encoder
+     *          counter has been set
+     */
+    void reset() {
+        reset_requested = true;
+    }
+
+    estimate get() const {
+        return published.read();
+    }
+
+    float position(uint32_t now) const;
+
+    float velocity() const {
+        return published.read().velocity;
+    }
+
+  public:
+    float alpha = 0.5f;
+    float beta = 0.1f;
+    float min_interval = 0.0005f; // s, closer measurements don't correct the velocity
+    float max_interval = 0.1f;    // s, older estimates are dropped instead of predicted
+
+  private:
+    estimate state = {};
+    bool valid = false;
+    std::atomic<bool> reset_requested = false;
+    seqlock<estimate> published;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+
+/**
+ * @class   arcgen
+ * @brief   step generator of the two axes of the plane of an arc, for the
+ *          interpolator.
+ * @details Integer midpoint circle: the position is kept in half pulses from
+ *          the center, with the error F = x^2 + y^2 - r^2 updated by
+ *          additions only. On every tick the axis the arc is steeper along
+ *          steps, and the other one too if that leaves the smaller |F|, so
+ *          the position never gets further than half a half pulse off the
+ *          circle.
+ *          Arcs are planned in segments that don't cross the axes of the
+ *          plane, so the direction of each axis is fixed along a segment,
+ *          and given with set_signs() when the segment is started. The
+ *          position carries over from one segment to the next.
+ *          Every tick moves along the circle between 1 and sqrt(2) half
+ *          pulses, scale_period() stretches the period of the tick by that
+ *          ratio so the tangential speed is the one of the profile.
+ * @note    step() and scale_period() are called from the step ISR
+ */
+class arcgen {
+  public:
+    static constexpr int RATIO_FRAC_BITS = 16;
+
+    void start(std::array<int32_t, 2> from, uint32_t radius, std::array<std::size_t, 2> axes);
+
+    /**
+     * @param   signs   : 1 for the axes stepping towards increasing counts,
+     *                    -1 for the ones stepping the other way, 0 for the
+     *                    ones that don't move
+     */
+    void set_signs(std::array<int8_t, 2> signs) {
+        this->signs = signs;
+    }
+
+    /**
+     * @brief   advances the arc one tick
+     * @returns the mask of the indexes of the axes that step, bit i for the
+     *          axis i of the interpolator
+     */
+    uint32_t step() {
+        std::size_t major = (std::abs(pos[0]) >= std::abs(pos[1])) ? 1 : 0; // the one stepping on every tick
+        std::size_t minor = 1 - major;
+
+        int64_t error_major = error + 2 * static_cast<int64_t>(pos[major]) * signs[major] + 1;
+        pos[major] += signs[major];
+        uint32_t mask = signs[major] ? masks[major] : 0;
+
+        if (signs[minor]) {
+            int64_t error_both = error_major + 2 * static_cast<int64_t>(pos[minor]) * signs[minor] + 1;
+            if (std::abs(error_both) < std::abs(error_major)) {
+                pos[minor] += signs[minor];
+                error = error_both;
+                return mask | masks[minor];
+            }
+        }
+        error = error_major;
+        return mask;
+    }
+
+    /**
+     * @returns the period of the profile stretched by the length of the arc
+     *          the next tick moves along, over the half pulse of its axis
+     *          stepping on every tick: the radius over the largest
+     *          coordinate
+     */
+    uint32_t scale_period(uint32_t period) const {
+        uint32_t along = static_cast<uint32_t>(std::max(std::abs(pos[0]), std::abs(pos[1]))) >> shift;
+        if (!along) {
+            return period;
+        }
+        uint32_t ratio = (scaled_radius << RATIO_FRAC_BITS) / along;
+        return (static_cast<uint64_t>(period) * ratio) >> RATIO_FRAC_BITS;
+    }
+
+    static uint32_t ticks(std::array<int32_t, 2> from, std::array<int32_t, 2> to, uint32_t radius);
+
+  public:
+    volatile bool active = false;
+
+  private:
+    std::array<int32_t, 2> pos = {}; // half pulses from the center
+    int64_t error = 0;               // x^2 + y^2 - r^2
+    std::array<int8_t, 2> signs = {};
+    std::array<uint32_t, 2> masks = {};
+    uint32_t scaled_radius = 0; // radius >> shift, under 2^15 for the ratio to fit
+    int shift = 0;
+};
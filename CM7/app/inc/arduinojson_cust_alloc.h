@@ -1,5 +1,8 @@
 #pragma once
 
+#include <cstddef>
+#include <cstring>
+
 #include "FreeRTOS.h"
 #include "stdio.h"
 
@@ -35,16 +38,135 @@ struct FreeRTOSAllocator : ArduinoJson::Allocator {
     virtual ~FreeRTOSAllocator() = default;
 };
 
+/**
+ * @brief   bump pointer allocator over a buffer, for the documents of a
+ *          request and its answer, reset once the answer is serialized.
+ * @details Every block has its size in front. Only the last block allocated
+ *          is given back when deallocated, and grown or shrunk in place when
+ *          reallocated, the others until reset(). Allocations that don't fit
+ *          fail, never the ones of the FreeRTOS heap.
+ */
+class ArenaAllocator : public ArduinoJson::Allocator {
+  public:
+    static constexpr size_t ALIGN = alignof(std::max_align_t);
+
+    ArenaAllocator(char *buffer, size_t size) : buffer(buffer), size(size) {
+    }
+
+    void *allocate(size_t size) override {
+        size_t block = round_up(size);
+        if (block + ALIGN > this->size - used) {
+            failed = true;
+            return NULL;
+        }
+        memcpy(buffer + used, &block, sizeof(block));
+        last = buffer + used + ALIGN;
+        used += ALIGN + block;
+        high_water = used > high_water ? used : high_water;
+        return last;
+    }
+
+    void deallocate(void *pointer) override {
+        if (pointer && pointer == last) {
+            used = static_cast<char *>(pointer) - ALIGN - buffer;
+            last = NULL;
+        }
+    }
+
+    void *reallocate(void *ptr, size_t new_size) override {
+        if (!ptr) {
+            return allocate(new_size);
+        }
+
+        size_t block = round_up(new_size);
+        if (ptr == last) {
+            size_t start = static_cast<char *>(ptr) - buffer;
+            if (block > this->size - start) {
+                failed = true;
+                return NULL;
+            }
+            memcpy(buffer + start - ALIGN, &block, sizeof(block));
+            used = start + block;
+            high_water = used > high_water ? used : high_water;
+            return ptr;
+        }
+
+        size_t old_block;
+        memcpy(&old_block, static_cast<char *>(ptr) - ALIGN, sizeof(old_block));
+        void *new_ptr = allocate(new_size);
+        if (new_ptr) {
+            memcpy(new_ptr, ptr, old_block < block ? old_block : block);
+        }
+        return new_ptr;
+    }
+
+    /**
+     * @brief   gives back every block, the documents allocated from the arena
+     *          must not be used anymore
+     */
+    void reset() {
+        used = 0;
+        last = NULL;
+        failed = false;
+    }
+
+    size_t high_water = 0; // bytes used at most
+    bool failed = false;   // an allocation didn't fit since the last reset()
+
+  private:
+    static size_t round_up(size_t size) {
+        return (size + ALIGN - 1) & ~(ALIGN - 1);
+    }
+
+    char *buffer;
+    size_t size;
+    size_t used = 0;
+    void *last = NULL;
+};
+
 namespace ArduinoJson {
+    /**
+     * @brief   document allocated from the FreeRTOS heap, or from the arena
+     *          of the ArenaScope of the network task in progress
+     */
     class MyJsonDocument : public ArduinoJson::JsonDocument {
       public:
-        MyJsonDocument() : ArduinoJson::JsonDocument(&allocator){};
+        MyJsonDocument() : ArduinoJson::JsonDocument(in_use){};
 
       private:
+        friend class ArenaScope;
+
         static FreeRTOSAllocator allocator;
+        static Allocator *in_use;
+    };
+
+    /**
+     * @brief   allocates the documents created while it exists from an
+     *          arena, which is reset when it ends
+     * @note    for the network task only, the documents of the other tasks
+     *          would be allocated from the arena too
+     */
+    class ArenaScope {
+      public:
+        explicit ArenaScope(ArenaAllocator &arena) : arena(arena), previous(MyJsonDocument::in_use) {
+            MyJsonDocument::in_use = &arena;
+        }
+
+        ~ArenaScope() {
+            MyJsonDocument::in_use = previous;
+            arena.reset();
+        }
+
+      private:
+        ArenaAllocator &arena;
+        Allocator *previous;
+
+        ArenaScope(ArenaScope const &) = delete;
+        void operator=(ArenaScope const &) = delete;
     };
 
 } // namespace ArduinoJson
 
 // Define the static allocator outside the class
 inline FreeRTOSAllocator ArduinoJson::MyJsonDocument::allocator;
+inline ArduinoJson::Allocator *ArduinoJson::MyJsonDocument::in_use = &ArduinoJson::MyJsonDocument::allocator;
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstdint>
+
+#include "gpio_templ.h"
+
+/**
+ * @struct  axis_traits
+ * @brief   compile time description of an axis: its name, the pin its step
+ *          pulses are output on and whether its direction and encoder are
+ *          reversed.
+ * @details The interpolator is instantiated on the traits of its axes, so
+ *          the step ISR toggles the step pins with direct BSRR writes to
+ *          constant addresses instead of going through a runtime gpio_base.
+ */
+template <char NAME, uint32_t STEP_PORT, uint16_t STEP_PIN, bool REVERSED_DIRECTION = false, bool REVERSED_ENCODER = false>
+struct axis_traits {
+    static constexpr char name = NAME;
+    static constexpr bool reversed_direction = REVERSED_DIRECTION;
+    static constexpr bool reversed_encoder = REVERSED_ENCODER;
+
+    using step = gpio_templ<STEP_PORT, STEP_PIN>;
+};
@@ -0,0 +1,19 @@
+#pragma once
+
+#include <cstdint>
+
+#define BIN_MAGIC 0xB5 // first byte of the binary frames, never the first one of a JSON batch
+
+/**
+ * @struct  bin_header
+ * @brief   header of the frames of the binary wire protocol, little endian,
+ *          followed by length bytes of MessagePack payload.
+ * @details The opcode is the index of the command in cmds_table, the seq is
+ *          echoed in the header of the answer.
+ */
+struct __attribute__((packed)) bin_header {
+    uint8_t magic; // BIN_MAGIC
+    uint8_t opcode;
+    uint16_t seq;
+    uint16_t length;
+};
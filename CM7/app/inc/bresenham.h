@@ -1,39 +1,111 @@
 #pragma once
 
+#include <array>
 #include <chrono>
+#include <cstddef>
 #include <cstdint>
 #include <string.h>
+#include <utility>
 
 #include "FreeRTOS.h"
+#include "arcgen.h"
 #include "debug.h"
 #include "gpio.h"
-#include "kp.h"
 #include "mot_pap.h"
+#include "planner.h"
+#include "profile.h"
 #include "semphr.h"
+#include "spsc_ring.h"
+#include "step_dma.h"
+#include "stepgen.h"
 #include "task.h"
 #include "tmr.h"
 
 #define TASK_PRIORITY            (configMAX_PRIORITIES - 3)
 #define SUPERVISOR_TASK_PRIORITY (configMAX_PRIORITIES - 1)
+#define COMMANDS_SIZE            8 // must be a power of two
+#define SCHEDULE_HALF            64 // step schedule ticks per buffer, must be a multiple of 8
+#define STEPGEN_UPDATE_TICKS     128 // ticks between two updates of the axes profiles, independent mode
+#define ARC_SEGMENTS             5 // an arc crosses the axes of its plane 4 times at most
+
+/**
+ * @struct  arc_params
+ * @brief   circle an ARC follows, from the end of the path to the setpoints.
+ */
+struct arc_params {
+    std::array<std::size_t, 2> axes; // indexes of the axes of the plane, counterclockwise is from the first towards the second
+    std::array<int, 2> center;       // counts
+    bool clockwise;
+};
 
 /**
  * @struct  bresenham_msg
  * @brief   messages to axis tasks.
  */
-struct bresenham_msg {
+template <std::size_t N> struct bresenham_msg {
     enum mot_pap::type type;
-    int first_axis_setpoint;
-    int second_axis_setpoint;
+    std::array<int, N> setpoints = {}; // one per axis, in the order the axes were given. Counts/s for JOG_VELOCITY
+    struct arc_params arc = {};        // ARC only
+    uint32_t named = UINT32_MAX;       // bit i for the axes the command gives. The others keep their velocities (JOG_VELOCITY)
 };
 
-class bresenham {
+/**
+ * @class   bresenham
+ * @brief   N-axis line interpolator.
+ * @details All the axes are stepped from a single timer interrupt by a
+ *          fixed-point DDA: every axis owns a Q32 accumulator that adds
+ *          delta / leader_delta on each tick and steps on carry. The leader
+ *          (the axis with the longest delta) steps on every tick.
+ *          MOVE commands are queued as segments of a path in a look-ahead
+ *          planner. The ISR starts the next segment as soon as the leader
+ *          has done its ticks, without stopping the timer, and only the last
+ *          one is finished in closed loop with the encoders.
+ *          The step frequency follows the velocity profile, which the ISR
+ *          advances on every tick, reloading the timer period for the next
+ *          one without stopping it.
+ *          The interpolator is instantiated on the axis_traits of its axes,
+ *          in the same order as the mot_pap objects it is given, so the step
+ *          pins are toggled with direct register writes: the edges of all
+ *          the axes stepping in a tick are gathered in one mask per GPIO
+ *          port and output with a single BSRR write.
+ *          With dma_steps the same ticks are computed ahead into a double
+ *          buffered step schedule, which the timer DMA outputs. Its
+ *          interrupt refills each half of the schedule once it has been
+ *          output, instead of interrupting on every tick. All the step pins
+ *          must then be in the same GPIO port.
+ *          In the independent mode (MOVE_INDEPENDENT) there is no path:
+ *          every axis goes to its own setpoint with its own stepgen profile,
+ *          and can be given another one while the rest keep moving. The timer
+ *          ticks at the max tick rate of the axes, and every
+ *          STEPGEN_UPDATE_TICKS the DDA increment of each axis is set to its
+ *          speed over that rate. The directions are changed by the
+ *          supervisor, once the axes have stopped.
+ *          Jogging (JOG_VELOCITY) is the independent mode with velocities
+ *          instead of setpoints: every update of the velocities is only
+ *          ramped to by the stepgens, the stepping goes on. The axes are
+ *          jogged to a stop if no update comes in jog_timeout.
+ *          Arcs (ARC) are queued in the path as segments that don't cross
+ *          the axes of their plane, whose two axes are stepped by an
+ *          integer midpoint circle generator (arcgen) instead of the DDA.
+ */
+template <typename... Axes> class bresenham {
   public:
+    static constexpr std::size_t N = sizeof...(Axes);
+    static constexpr int DDA_FRAC_BITS = 32;
+    static constexpr uint64_t DDA_ONE = uint64_t(1) << DDA_FRAC_BITS;
+
     bresenham() = delete;
 
-    explicit bresenham(const char *name, mot_pap *first_axis, mot_pap *second_axis, class tmr t, bool has_brakes = false)
-        : name(name), first_axis(first_axis), second_axis(second_axis), tmr(t), has_brakes(has_brakes) {
+    explicit bresenham(const char *name, std::array<mot_pap *, N> axes, class tmr t, bool has_brakes = false)
+        : name(name), axes(axes), tmr(t), has_brakes(has_brakes) {
+
+        constexpr char traits_names[] = { Axes::name... };
+        for (std::size_t i = 0; i < N; i++) {
+            configASSERT(axes[i]->name == traits_names[i]);
+        }
+
+        profile.clock_hz = tmr.get_clock_hz();
 
-        queue = xQueueCreate(5, sizeof(struct bresenham_msg *));
         supervisor_semaphore = xSemaphoreCreateBinary();
 
         char supervisor_task_name[configMAX_TASK_NAME_LEN];
@@ -46,7 +118,7 @@ class bresenham {
             xTaskCreate(
                 [](void *axes) { static_cast<bresenham *>(axes)->supervise(); },
                 supervisor_task_name,
-                256,
+                configMINIMAL_STACK_SIZE * 2,
                 this,
                 SUPERVISOR_TASK_PRIORITY,
                 &supervisor_task_handle);
@@ -57,7 +129,7 @@ class bresenham {
         memset(task_name, 0, sizeof(task_name));
         strncat(task_name, name, sizeof(task_name) - strlen(task_name) - 1);
         strncat(task_name, "_task", sizeof(task_name) - strlen(task_name) - 1);
-        xTaskCreate([](void *axes) { static_cast<bresenham *>(axes)->task(); }, task_name, 256, this, TASK_PRIORITY, NULL);
+        xTaskCreate([](void *axes) { static_cast<bresenham *>(axes)->task(); }, task_name, configMINIMAL_STACK_SIZE * 2, this, TASK_PRIORITY, &task_handle);
 
         lDebug(Info, "%s: created", task_name);
     }
@@ -70,16 +142,42 @@ class bresenham {
 
     void supervise();
 
-    void move(int first_axis_setpoint, int second_axis_setpoint);
+    void check_for_stall();
+
+    void move(std::array<int, N> setpoints);
+
+    void move_independent(std::array<int, N> setpoints);
+
+    void jog(std::array<int, N> velocities);
+
+    bool append(std::array<int, N> setpoints);
+
+    void move_arc(std::array<int, N> setpoints, arc_params const &arc);
+
+    bool append_arc(std::array<int, N> setpoints, arc_params const &arc);
 
     void step();
 
-    void send(bresenham_msg msg);
+    void send(bresenham_msg<N> msg);
+
+    int axis_index(char name) const;
+
+    int hold_setpoint(std::size_t index) const;
+
+    int hold_velocity(std::size_t index) const;
+
+    bool is_final_segment() const;
 
     void isr();
 
+    void dma_isr();
+
     void stop();
 
+    void hard_stop();
+
+    void hard_stop_from_isr(BaseType_t *higher_priority_task_woken);
+
     void pause();
 
     void resume();
@@ -87,29 +185,161 @@ class bresenham {
   public:
     const char *name;
     volatile bool is_moving = false;
-    volatile int current_freq = 0;
     std::chrono::milliseconds step_time = std::chrono::milliseconds(100);
     TickType_t ticks_last_time = 0;
-    QueueHandle_t queue;
+    spsc_ring<bresenham_msg<N>, COMMANDS_SIZE> commands; // filled by send(), from a single task
+    volatile uint32_t commands_sent = 0;                 // by send()
+    volatile uint32_t commands_done = 0;                 // by the axis task, once applied or dropped
+    std::array<int, N> commanded = {};                   // setpoints of the last command sent, by send()
+    bool commanded_known = false;                        // whether the last command sent gave the setpoints of all the axes
+    TaskHandle_t task_handle = nullptr;
     SemaphoreHandle_t supervisor_semaphore;
     TaskHandle_t supervisor_task_handle = nullptr;
-    mot_pap *first_axis = nullptr;
-    mot_pap *second_axis = nullptr;
+    std::array<mot_pap *, N> axes;
     mot_pap *leader_axis = nullptr;
+    std::array<uint64_t, N> dda_increment = {};
+    std::array<uint64_t, N> dda_accumulator = {};
+    std::array<uint32_t, N> step_levels = {}; // step pins state of the port of each axis, kept by the first axis on it
+    bool dma_steps = false;                   // steps output by the timer DMA from a step schedule, not by isr()
+    class step_dma dma;
+    step_schedule<SCHEDULE_HALF> schedule;
+    volatile enum step_dma::half schedule_end_half = step_dma::NONE; // the half the path ends in, once computed
+    volatile uint32_t ticks_left = 0;  // leader ticks to the end of the current segment
+    volatile uint32_t segment_seq = 0; // bumped every time a segment is started
+    volatile uint32_t encoder_seq = 0; // segment_seq of the targets the encoders were given
+    volatile uint32_t direction_seq = 0; // segment_seq of the directions the encoders were given
+    std::array<int32_t, N> encoder_directions = {}; // as last written to the encoders
+    class planner<N> planner;
     class tmr tmr;
     volatile bool already_there = false;
+    volatile bool hard_stop_requested = false; // the timer is stopped, the axis task must finish the stop
+    volatile uint32_t hard_stop_sent = 0;      // commands_sent when it was requested, the ones to drop
     volatile bool was_soft_stopped = false;
     volatile bool was_stopped_by_probe = false;
     volatile bool was_stopped_by_probe_protection = false;
     volatile int touching_counter = 0;
     int touching_max_count = 3;
     bool has_brakes = false;
-    class kp kp;
-    volatile int error;
+    class profile profile;
+    class arcgen arcgen;
+    volatile bool independent = false; // the axes follow their stepgens, not a path
+    std::array<stepgen, N> stepgens;
+    uint32_t stepgen_ticks = 0;  // ticks from the last update of the stepgens
+    uint32_t stepgen_period = 0; // timer counts per tick, independent mode
+    float stepgen_tick_rate = 0; // ticks/s, independent mode
+    TickType_t last_jog_tick = 0;
+    std::chrono::milliseconds jog_timeout = std::chrono::milliseconds(500);
 
   private:
+    bool ready_to_move();
+
+    bool begin_path(std::array<int, N> &from, float &freq_per_speed);
+
+    void start_path(segment<N> const &seg, float freq_per_speed);
+
+    bool queue_segment(segment<N> const &seg);
+
+    void start_stepping();
+
+    void start_independent();
+
+    void update_stepgens(BaseType_t *higher_priority_task_woken);
+
+    void supervise_independent();
+
+    void soft_stop_independent();
+
+    bool is_jogging() const;
+
+    bool is_jog_finished() const;
+
+    uint32_t next_period();
+
     void calculate();
 
+    bool plan_segment(std::array<int, N> const &from, std::array<int, N> const &to, segment<N> &seg) const;
+
+    template <typename F>
+    std::size_t plan_arc(std::array<int, N> const &from,
+                         std::array<int, N> const &to,
+                         arc_params const &arc,
+                         segment<N> &seg,
+                         F push) const;
+
+    bool plan_arc_segment(std::array<int, N> const &from,
+                          std::array<int, N> const &to,
+                          arc_params const &arc,
+                          uint32_t radius,
+                          segment<N> &seg) const;
+
+    void load_dda(segment<N> const &seg);
+
+    void next_segment();
+
+    void program_encoders();
+
+    void write_directions();
+
+    void write_encoders_setup();
+
+    void load_profile(segment<N> const &seg);
+
+    void run_profile();
+
+    bool begin_tick(BaseType_t *higher_priority_task_woken);
+
+    void end_tick(BaseType_t *higher_priority_task_woken);
+
+    template <std::size_t... I> std::array<uint32_t, N> step_axes(std::index_sequence<I...>);
+
+    template <std::size_t I> uint32_t step_axis(uint32_t arc_steps);
+
+    template <std::size_t... I> void output_steps(std::array<uint32_t, N> const &toggles, std::index_sequence<I...>);
+
+    template <std::size_t I> void output_port(std::array<uint32_t, N> const &toggles);
+
+    uint32_t step_port_bsrr(std::array<uint32_t, N> const &toggles);
+
+    void sync_step_levels();
+
+    void fill_schedule(enum step_dma::half half, BaseType_t *higher_priority_task_woken);
+
+    void start_schedule();
+
+    static constexpr std::array<uint32_t, N> step_ports = { Axes::step::port_base... };
+
+    static constexpr std::array<uint16_t, N> step_masks = { Axes::step::mask... };
+
+    /**
+     * @brief   whether the axis is the first one whose step pin is in its
+     *          GPIO port, the one that outputs the steps of the port
+     */
+    static constexpr bool is_first_on_port(std::size_t index) {
+        for (std::size_t i = 0; i < index; i++) {
+            if (step_ports[i] == step_ports[index]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    /**
+     * @brief   whether all the step pins are in the same GPIO port, as the
+     *          step schedule requires
+     */
+    static constexpr bool is_single_port() {
+        for (std::size_t i = 1; i < N; i++) {
+            if (step_ports[i] != step_ports[0]) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void request_hard_stop();
+
+    void finish_hard_stop();
+
     bresenham(bresenham const &) = delete;
     void operator=(bresenham const &) = delete;
 
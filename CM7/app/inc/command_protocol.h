@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "arduinojson_cust_alloc.h"
+#include "bin_protocol.h"
+
+namespace json = ArduinoJson;
+
+#define COMMAND_ARENA_SIZE 16384 // bytes, for the documents of a batch and its answer
+
+// The commands, by name and by the member of tcp_server_command that
+// executes them. The index of a command is its opcode in the binary
+// protocol, new commands go at the end
+// @formatter:off
+#define COMMANDS(X)                                         \
+    X("PROTOCOL_VERSION",       protocol_version_cmd)       \
+    X("CONTROL_ENABLE",         control_enable_cmd)         \
+    X("BRAKES_MODE",            brakes_mode_cmd)            \
+    X("TOUCH_PROBE",            touch_probe_cmd)            \
+    X("STALL_CONTROL_SETTINGS", stall_control_settings_cmd) \
+    X("TOUCH_PROBE_SETTINGS",   touch_probe_settings_cmd)   \
+    X("AXES_HARD_STOP_ALL",     axes_hard_stop_all_cmd)     \
+    X("AXES_SOFT_STOP_ALL",     axes_soft_stop_all_cmd)     \
+    X("LOGS",                   logs_cmd)                   \
+    X("LOG_LEVEL",              log_level_cmd)              \
+    X("AXES_SETTINGS",          axes_settings_cmd)          \
+    X("NETWORK_SETTINGS",       network_settings_cmd)       \
+    X("MEM_INFO",               mem_info_cmd)               \
+    X("TEMP_INFO",              temperature_info_cmd)       \
+    X("SET_COORDS",             set_coords_cmd)             \
+    X("MOVE_JOYSTICK",          move_joystick_cmd)          \
+    X("MOVE_CLOSED_LOOP",       move_closed_loop_cmd)       \
+    X("JOG_VELOCITY",           jog_velocity_cmd)           \
+    X("MOVE_INDEPENDENT",       move_independent_cmd)       \
+    X("ARC",                    arc_cmd)                    \
+    X("MOVE_INCREMENTAL",       move_incremental_cmd)       \
+    X("READ_ENCODERS",          read_encoders_cmd)          \
+    X("READ_LIMITS",            read_limits_cmd)            \
+    X("PROFILE",                profile_cmd)
+// @formatter:on
+
+/**
+ * @class   command_protocol
+ * @brief   the wire protocols of the command server, JSON and binary, over
+ *          the commands of a derived class.
+ * @details Independent of the network, tcp_server_command receives the
+ *          messages and sends the answers. The documents of a message and of
+ *          its answer are allocated from the arena, within an ArenaScope of
+ *          the caller.
+ */
+class command_protocol {
+  public:
+    // In the order of COMMANDS, the opcodes of the binary protocol
+#define COMMAND_NAME(name, function) name,
+    static constexpr char const *cmds_names[] = { COMMANDS(COMMAND_NAME) };
+#undef COMMAND_NAME
+    static constexpr std::size_t cmds_count = sizeof(cmds_names) / sizeof(cmds_names[0]);
+
+    static int cmd_index(char const *cmd);
+
+    int json_wp(char *rx_buff, char *tx_buff, std::size_t tx_size);
+
+    int bin_wp(char const *rx_buff, std::size_t len, char *tx_buff, std::size_t tx_size);
+
+  protected:
+    command_protocol() : arena(arena_buffer, sizeof(arena_buffer)) {
+    }
+
+    virtual ~command_protocol() = default;
+
+    json::MyJsonDocument cmd_execute(char const *cmd, json::JsonObject const pars);
+
+    /**
+     * @brief   executes the command of cmds_names[] at the opcode index, or
+     *          answers an unknown one
+     */
+    virtual json::MyJsonDocument cmd_execute(std::size_t opcode, json::JsonObject const pars) = 0;
+
+    // One message at a time, of any connection. Static storage, not in the
+    // object
+    alignas(std::max_align_t) static inline char arena_buffer[COMMAND_ARENA_SIZE];
+    ArenaAllocator arena;
+};
@@ -0,0 +1,92 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "board.h"
+
+/**
+ * @class   cycle_stats
+ * @brief   min, max, mean and histogram of the duration of a code section,
+ *          in core cycles counted by the DWT.
+ * @details The histogram has power of two buckets: bucket 0 counts the
+ *          samples under FIRST_BUCKET_CYCLES, bucket i the ones under
+ *          FIRST_BUCKET_CYCLES << i, and the last one everything above.
+ * @note    record() may be called from an ISR. snapshot() and reset() mask
+ *          the interrupts the RTOS manages while they run.
+ */
+class cycle_stats {
+  public:
+    static constexpr int BUCKETS = 16;
+    static constexpr uint32_t FIRST_BUCKET_CYCLES = 64;
+
+    void record(uint32_t cycles);
+
+    cycle_stats snapshot() const;
+
+    void reset();
+
+    uint32_t mean() const {
+        return count ? total / count : 0;
+    }
+
+  public:
+    uint32_t count = 0;
+    uint32_t min = UINT32_MAX;
+    uint32_t max = 0;
+    uint64_t total = 0;
+    std::array<uint32_t, BUCKETS> histogram = {};
+};
+
+/**
+ * @brief   current value of the DWT cycle counter, enabled in
+ *          prvSetupHardware()
+ */
+static inline uint32_t cycle_counter() {
+    return DWT->CYCCNT;
+}
+
+#ifdef SIMULATION
+// The axes of the host simulation move on its virtual clock, see sim/inc/sim.h
+extern "C" uint32_t sim_virtual_cycles(void);
+#endif
+
+/**
+ * @brief   time base of the encoder snapshots and of the observers, in DWT
+ *          cycles
+ */
+static inline uint32_t timestamp_counter() {
+#ifdef SIMULATION
+    return sim_virtual_cycles();
+#else
+    return cycle_counter();
+#endif
+}
+
+/**
+ * @class   cycle_scope
+ * @brief   records the cycles spent from its construction to the end of the
+ *          enclosing scope.
+ */
+class cycle_scope {
+  public:
+    explicit cycle_scope(cycle_stats &stats) : stats(stats), start(cycle_counter()) {
+    }
+
+    ~cycle_scope() {
+        stats.record(cycle_counter() - start);
+    }
+
+  private:
+    cycle_stats &stats;
+    uint32_t start;
+
+    cycle_scope(cycle_scope const &) = delete;
+    void operator=(cycle_scope const &) = delete;
+};
+
+inline cycle_stats step_isr_cycles;  // bresenham::isr(), or dma_isr() with step schedules
+inline cycle_stats supervise_cycles; // one bresenham::supervise() iteration
+inline cycle_stats encoders_cycles;  // one encoders_pico::task() iteration
+inline cycle_stats json_wp_cycles;   // command_protocol::json_wp()
+inline cycle_stats bin_wp_cycles;    // command_protocol::bin_wp()
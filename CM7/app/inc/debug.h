@@ -173,7 +173,7 @@ static inline char *make_message(const char *fmt, ...) {
             if (uart_mutex != NULL && xSemaphoreTake(uart_mutex, portMAX_DELAY) == pdTRUE) {                            \
                 printf(                                                                                                 \
                     "%lu - %s %s[%d] %s() " fmt "\n",                                                                   \
-                    xTaskGetTickCount(),                                                                                \
+                    static_cast<unsigned long>(xTaskGetTickCount()),                                                    \
                     levelText(level),                                                                                   \
                     __FILE__,                                                                                           \
                     __LINE__,                                                                                           \
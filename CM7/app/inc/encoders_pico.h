@@ -11,9 +11,12 @@
 #include "gpio.h"
 #include "gpio_templ.h"
 #include "quadrature_encoder_constants.h"
+#include "seqlock.h"
 #include "spi.h"
 
 #define ENCODERS_PICO_TASK_PRIORITY (configMAX_PRIORITIES - 1)
+#define ENCODERS_PICO_POLL_TASK_PRIORITY (configMAX_PRIORITIES - 2)
+#define ENCODERS_PICO_POLL_RATE_HZ       1000 // Up to configTICK_RATE_HZ
 #define ENCODERS_PICO_INTERRUPT_PRIORITY                                                                                    \
     (configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY + 1) // Has to have higher priority than timers ( now +2 )
 
@@ -24,6 +27,33 @@ struct limits {
     uint8_t targets;
 };
 
+/**
+ * @struct  encoders_snapshot
+ * @brief   the counters, hard limits and target flags of all the encoders,
+ *          latched by the Pico at the same time
+ */
+struct encoders_snapshot {
+    int32_t counters[3];
+    struct limits limits;
+    uint32_t timestamp;  // timestamp_counter() when the transfer ended
+    uint32_t generation; // counters writes before the transfer
+
+    int32_t counter(char axis) const {
+        return counters[axis - 'X'];
+    }
+};
+
+/**
+ * @struct  axes_setup
+ * @brief   the registers the encoders need to follow a segment, written at
+ *          once in the AXES_SETUP block if the Pico has it
+ */
+struct axes_setup {
+    int32_t targets[3];
+    int32_t directions[3];
+    int32_t threshold;
+};
+
 /**
  * @brief   handles the CS line for the ENCODERS RASPBERRY PI PICO
  * @param   state    : boolean value for the output
@@ -46,6 +76,12 @@ static void cs_function(bool state) {
 class encoders_pico {
 
   public:
+    // The SNAPSHOT and AXES_SETUP blocks are read and written in one transfer
+    // when quadrature_encoder_constants.h, shared with the Pico firmware,
+    // defines QUADRATURE_ENCODER_BLOCKS: a Pico built from it serves them.
+    // Otherwise the registers are read and written one by one, as the Pico
+    // firmware that doesn't have them expects
+
     encoders_pico() {
         // Chip_SCU_PinMuxSet(
         //     6,
@@ -61,9 +97,11 @@ class encoders_pico {
         if (encoders_pico_semaphore != NULL) {
             // Create the 'handler' task, which is the task to which interrupt
             // processing is deferred
-            xTaskCreate(encoders_pico::task, "encoders_pico", 256, NULL, ENCODERS_PICO_TASK_PRIORITY, NULL);
+            xTaskCreate(encoders_pico::task, "encoders_pico", configMINIMAL_STACK_SIZE * 2, NULL, ENCODERS_PICO_TASK_PRIORITY, NULL);
             lDebug(Info, "encoders_pico_task created");
         }
+
+        xTaskCreate(encoders_pico::poll_task, "encoders_poll", configMINIMAL_STACK_SIZE * 2, NULL, ENCODERS_PICO_POLL_TASK_PRIORITY, NULL);
     }
 
     ~encoders_pico() {
@@ -72,16 +110,30 @@ class encoders_pico {
 
     static void task(void *pars);
 
+    static void poll_task(void *pars);
+
     int32_t read_register(uint8_t address) const;
 
     void read_4_registers(uint8_t address, uint8_t *rx) const;
 
     int32_t write_register(uint8_t address, int32_t data) const;
 
+    int32_t write_axes_setup(struct axes_setup const &setup) const;
+
     struct limits read_limits() const;
 
     struct limits read_limits_and_ack() const;
 
+    struct encoders_snapshot read_snapshot() const;
+
+    /**
+     * @returns the snapshot last published by the poller, without any SPI
+     *          transfer
+     */
+    struct encoders_snapshot latest() const {
+        return published.read();
+    }
+
     void set_target(char axis, int target) {
         write_register(quadrature_encoder_constants::TARGETS + (axis - 'X') + 1, target);
     }
@@ -108,6 +160,8 @@ class encoders_pico {
 
   public:
     void (*cs)(bool) = cs_function; ///< pointer to CS line function handler
+    seqlock<struct encoders_snapshot> published;
+    mutable volatile uint32_t counters_generation = 0; // incremented on every counter write
 };
 
 inline encoders_pico *encoders = nullptr;
@@ -37,7 +37,7 @@ class gpio_pinint : public gpio_base {
   public:
     //LPC43XX_IRQn_Type IRQn;
 
-    gpio_pinint(GPIO_TypeDef* gpio, uint16_t pin, IRQn_Type IRQn)
+    gpio_pinint(GPIO_TypeDef* gpio, uint16_t pin, [[maybe_unused]] IRQn_Type IRQn)
         : gpio_base(gpio, pin) {//, IRQn(IRQn) {
         //int irq = static_cast<int>(IRQn) - PIN_INT0_IRQn;
 
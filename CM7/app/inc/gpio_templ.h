@@ -2,27 +2,41 @@
 
 #include "board.h"
 
+/**
+ * @class   gpio_templ
+ * @brief   GPIO pin known at compile time.
+ * @details Writes go straight to BSRR, which sets or resets the pin in a
+ *          single store without a read-modify-write of ODR.
+ */
 template< uint32_t gpio_base, uint16_t pin>
 class gpio_templ {
   public:
+    static constexpr uint32_t port_base = gpio_base;
+    static constexpr uint16_t mask = pin;
+
+    static GPIO_TypeDef *port() {
+        return reinterpret_cast<GPIO_TypeDef*>(gpio_base);
+    }
+
     static void set() {
-        HAL_GPIO_WritePin(reinterpret_cast<GPIO_TypeDef*>(gpio_base), pin, GPIO_PIN_SET);
+        port()->BSRR = pin;
     }
 
     static void reset() {
-        HAL_GPIO_WritePin(reinterpret_cast<GPIO_TypeDef*>(gpio_base), pin, GPIO_PIN_RESET);
+        port()->BSRR = static_cast<uint32_t>(pin) << 16;
     }
 
     static void set(bool state) {
-        HAL_GPIO_WritePin(reinterpret_cast<GPIO_TypeDef*>(gpio_base), pin, state ? GPIO_PIN_SET : GPIO_PIN_RESET);
+        state ? set() : reset();
     }
 
     static void toggle() {
-        HAL_GPIO_TogglePin(reinterpret_cast<GPIO_TypeDef*>(gpio_base), pin);        
+        uint32_t odr = port()->ODR;
+        port()->BSRR = ((odr & pin) << 16) | (~odr & pin);
     }
 
     static bool read() {
-        return HAL_GPIO_ReadPin(reinterpret_cast<GPIO_TypeDef*>(gpio_base), pin);
+        return HAL_GPIO_ReadPin(port(), pin);
     }
 };
 
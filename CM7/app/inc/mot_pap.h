@@ -4,8 +4,9 @@
 #include <cstdlib>
 
 #include "FreeRTOS.h"
+#include "alpha_beta.h"
+#include "cycles.h"
 #include "encoders_pico.h"
-#include "gpio.h"
 #include "semphr.h"
 #include "tmr.h"
 
@@ -27,26 +28,22 @@ class mot_pap {
         NONE,
     };
 
-    enum type { MOVE, SOFT_STOP, HARD_STOP };
-
-    /**
-     * @struct 	mot_pap_gpios
-     * @brief	pointers to functions to handle GPIO lines of this stepper
-     * motor.
-     */
-    struct gpios {
-        gpio_base step;
-    };
+    enum type { MOVE, ARC, MOVE_JOYSTICK, MOVE_INDEPENDENT, JOG_VELOCITY, SOFT_STOP, HARD_STOP };
 
     mot_pap() = delete;
 
+    /**
+     * @param   traits : the axis_traits of the axis. Its step pin is driven
+     *          by the interpolator the axis is given to
+     */
+    template <typename Traits>
     explicit mot_pap(
-        const char name,
+        Traits,
         int motor_resolution,
         int encoder_resolution,
-        int turns_per_inch,
-        bool is_dummy = false)
-        : name(name), motor_resolution(motor_resolution), encoder_resolution(encoder_resolution), is_dummy(is_dummy) {
+        int turns_per_inch)
+        : name(Traits::name), motor_resolution(motor_resolution), encoder_resolution(encoder_resolution),
+          reversed_direction(Traits::reversed_direction), reversed_encoder(Traits::reversed_encoder) {
         inches_to_counts_factor = turns_per_inch * encoder_resolution * 4; // 4 means Full Quadrature Counting
     }
 
@@ -55,64 +52,187 @@ class mot_pap {
     void set_position(double pos) {
         int counts = static_cast<int>(pos * inches_to_counts_factor); // Thread safety is important here
         counts = reversed_encoder ? -counts : counts;
-        encoders->set_counter(name, counts);
+        encoders->set_counter(name, counts); // the observer restarts when the poller sees the new generation
         current_counts = counts; // Touch current_counts in just one place
+        anchor_commanded();
     }
 
     void read_pos_from_encoder();
 
-    void set_gpios(struct gpios gpios) {
-        this->gpios = gpios;
+    void set_pos_from_encoder(int32_t counts) {
+        current_counts = reversed_encoder ? -counts : counts;
+    }
+
+    /**
+     * @brief   feeds the observer with the counter of the axis
+     * @note    called by the encoders poller only
+     */
+    void observe(struct encoders_snapshot const &snapshot) {
+        if (snapshot.generation != observed_generation) {
+            observed_generation = snapshot.generation;
+            observer.reset(); // the counter was set, the estimate is meaningless
+        }
+        int32_t counts = snapshot.counter(name);
+        observer.update(reversed_encoder ? -counts : counts, snapshot.timestamp);
+    }
+
+    /**
+     * @returns the position estimated by the observer right now, in counts
+     */
+    float estimated_counts() const {
+        return observer.position(timestamp_counter());
+    }
+
+    /**
+     * @returns the velocity estimated by the observer, in counts/s
+     */
+    float estimated_velocity() const {
+        return observer.velocity();
+    }
+
+    /**
+     * @brief   makes the current position the origin of the commanded one
+     * @note    the steps must be stopped
+     */
+    void anchor_commanded() {
+        commanded_origin = current_counts;
+        commanded_half_pulses = 0;
+    }
+
+    /**
+     * @returns the position the steps output from the anchor lead to, in
+     *          counts
+     * @note    with the steps output by the DMA, the ones already scheduled
+     *          are included
+     * @note    the half pulses are converted with one division, so that the
+     *          ratio of the resolutions doesn't accumulate rounding errors
+     */
+    float commanded_counts() const {
+        int64_t numerator = static_cast<int64_t>(commanded_half_pulses) * 2 * encoder_resolution;
+        return commanded_origin + static_cast<float>(numerator) / motor_resolution;
+    }
+
+    /**
+     * @returns the half pulses from the anchor to a position, signed as
+     *          commanded_half_pulses
+     */
+    int32_t half_pulses_from_anchor(int counts) const {
+        int64_t numerator = static_cast<int64_t>(counts - commanded_origin) * motor_resolution;
+        return numerator / (2 * encoder_resolution);
+    }
+
+    /**
+     * @returns the position some half pulses from the anchor lead to, in
+     *          counts
+     */
+    int counts_from_anchor(int32_t half_pulses) const {
+        int64_t numerator = static_cast<int64_t>(half_pulses) * 2 * encoder_resolution;
+        return commanded_origin + numerator / motor_resolution;
+    }
+
+    /**
+     * @returns the commanded position minus the estimated one, in counts
+     */
+    float following_error() const {
+        return commanded_counts() - estimated_counts();
+    }
+
+    float steps_per_count() const {
+        return motor_resolution / (4.0f * encoder_resolution); // 4 means Full Quadrature Counting
+    }
+
+    /**
+     * @brief   timer ticks (half pulses) needed to move a number of counts
+     */
+    uint32_t counts_to_half_pulses(int counts) const {
+        return static_cast<uint64_t>(counts) * 2 * motor_resolution / (4 * encoder_resolution);
     }
 
     void set_direction(enum direction direction);
 
     void set_direction();
 
+    /**
+     * @note    the target is given to the encoders by the interpolator, with
+     *          the ones of the other axes. See encoder_target()
+     */
     void set_destination_counts(int target) {
         int error = target - current_counts;
         already_there = (std::abs(error) < MOT_PAP_POS_THRESHOLD);
 
         destination_counts = target;
-        if (is_dummy) {
-            return;
-        }
+    }
 
-        encoders->set_target(name, reversed_encoder ? -target : target);
+    /**
+     * @returns the destination, as counted by the encoder of the axis
+     */
+    int32_t encoder_target() const {
+        return reversed_encoder ? -destination_counts : destination_counts;
+    }
+
+    /**
+     * @returns the direction, as given to the encoders
+     */
+    int32_t encoder_direction() const {
+        return dir == direction::CW ? 0 : 1;
+    }
+
+    /**
+     * @returns 1 if the axis steps towards increasing counts, -1 otherwise
+     */
+    int direction_sign() const {
+        return ((dir == direction::CCW) != reversed_direction) ? 1 : -1;
     }
 
-    void step();
+    /**
+     * @brief   accounts for a half pulse, the step pin itself is toggled by
+     *          the interpolator
+     * @note    called from the step ISR
+     */
+    void step() {
+        ++half_pulses;
+        commanded_half_pulses += direction_sign();
+
+#ifdef SIMULATE_ENCODER
+        update_position_simulated();
+#endif
+    }
 
     void update_position();
 
     void update_position_simulated();
 
+    /**
+     * @brief   checks the following error against the window of the axis
+     * @returns true if the axis stalled
+     */
     bool check_for_stall();
 
     void stall_reset();
 
-    bool check_already_there();
+    bool check_already_there() const {
+        return already_there; // set by encoders_pico
+    }
 
   public:
     const char name;
     enum type type = HARD_STOP;
     volatile enum direction dir = direction::NONE;
-    volatile int last_pos = 0;
     int inches_to_counts_factor = 0;
     int motor_resolution = 0;
     int encoder_resolution = 0;
-    volatile int stalled_counter = 0;
-    int stall_max_count = 5;
+    int following_error_window = 50; // counts
     volatile int delta = 0;
-    struct gpios gpios;
     enum direction last_dir = direction::NONE;
-    unsigned int half_pulses_stall = 0;    // counts steps from the last call to stall control
     volatile unsigned int half_pulses = 0; // counts steps for encoder simulation
     volatile bool already_there = false;
     volatile bool stalled = false;
-    bool reversed_direction = false;
-    bool reversed_encoder = false;
+    const bool reversed_direction;
+    const bool reversed_encoder;
     volatile int current_counts = 0;
     volatile int destination_counts = 0;
-    bool is_dummy;
+    volatile int commanded_origin = 0;
+    volatile int commanded_half_pulses = 0; // signed, from the anchor
+    alpha_beta observer;
+    uint32_t observed_generation = 0; // of the encoders counters
 };
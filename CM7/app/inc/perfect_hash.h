@@ -0,0 +1,94 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class   perfect_hash
+ * @brief   index of a table of N entries by a string key, built at compile
+ *          time, that maps every key of the table to a slot of its own.
+ * @details The keys are hashed with FNV-1a from a seed, and the first seed
+ *          under MAX_SEEDS that leaves no two keys in the same slot is kept.
+ *          SLOTS is the power of two at least four times N, so that one is
+ *          found in a few hundred tries.
+ *          find() costs one hash of the key whatever N is, but any key that
+ *          isn't in the table maps to a slot too: the caller compares it with
+ *          the key of the entry found.
+ */
+template <std::size_t N> class perfect_hash {
+  public:
+    static_assert(N < UINT8_MAX, "the slots keep the index of the entry plus one in a byte");
+
+    static constexpr std::size_t SLOTS = [] {
+        std::size_t slots = 1;
+        while (slots < 4 * N) {
+            slots *= 2;
+        }
+        return slots;
+    }();
+    static constexpr uint32_t MAX_SEEDS = 100000;
+
+    /**
+     * @param   entries : the table
+     * @param   key     : member of the entries with their key
+     */
+    template <typename Entry>
+    constexpr perfect_hash(Entry const (&entries)[N], char const *Entry::*key) {
+        search([&](std::size_t i) { return entries[i].*key; });
+    }
+
+    /**
+     * @param   keys    : the table, of the keys alone
+     */
+    constexpr perfect_hash(char const *const (&keys)[N]) {
+        search([&](std::size_t i) { return keys[i]; });
+    }
+
+    /**
+     * @returns whether a seed was found, so that every key has a slot
+     */
+    constexpr bool found() const {
+        return seed < MAX_SEEDS;
+    }
+
+    /**
+     * @returns the index of the only entry that may have the key, or -1 if
+     *          there is none
+     */
+    constexpr int find(char const *key) const {
+        return static_cast<int>(slots[hash(key, seed) & (SLOTS - 1)]) - 1;
+    }
+
+  private:
+    static constexpr uint32_t hash(char const *key, uint32_t seed) {
+        uint32_t h = 2166136261u ^ seed;
+        while (*key) {
+            h = (h ^ static_cast<uint8_t>(*key++)) * 16777619u;
+        }
+        return h ^ (h >> 16);
+    }
+
+    template <typename F> constexpr void search(F key_of) {
+        for (seed = 0; seed < MAX_SEEDS; seed++) {
+            if (try_seed(key_of)) {
+                return;
+            }
+        }
+    }
+
+    template <typename F> constexpr bool try_seed(F key_of) {
+        slots = {};
+        for (std::size_t i = 0; i < N; i++) {
+            uint8_t &slot = slots[hash(key_of(i), seed) & (SLOTS - 1)];
+            if (slot) {
+                return false;
+            }
+            slot = i + 1;
+        }
+        return true;
+    }
+
+    uint32_t seed = 0;
+    std::array<uint8_t, SLOTS> slots = {};
+};
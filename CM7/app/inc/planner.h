@@ -0,0 +1,112 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+#include "mot_pap.h"
+
+/**
+ * @struct  segment
+ * @brief   straight line, or arc of a circle, of a path, with everything
+ *          the step ISR needs to start it precomputed.
+ * @details Arcs are split at the axes of their plane, so every axis keeps its
+ *          direction along a segment. Their plane axes are stepped by the
+ *          arcgen, the DDA increments of all the axes are 0.
+ */
+template <std::size_t N> struct segment {
+    std::array<int, N> target;                  // encoder counts at the end of the segment
+    std::array<int, N> delta;                   // counts travelled by every axis
+    std::array<enum mot_pap::direction, N> dir; // direction of every axis
+    std::array<uint64_t, N> dda_increment;      // Q32 DDA increments, see bresenham
+    std::size_t leader;                         // index of the axis with the longest delta
+    uint32_t ticks;                             // timer ticks (leader half pulses) to the end
+    std::array<float, N> unit;                  // direction of travel, normalized
+    std::array<float, N> exit_unit;             // direction of travel at the end, the same as unit for lines
+    float length;                               // counts
+    float freq_per_speed;                       // leader step frequency per count/s of path speed
+    float nominal_speed;                        // counts/s, the leader at its max frequency
+    float min_speed;                            // counts/s, the leader at its min frequency
+    float max_entry_speed;                      // counts/s, limited by the junction with the previous segment
+    float entry_speed;                          // counts/s, planned
+    bool is_arc;                                // see arcgen
+    bool arc_continued;                         // continues the arc of the previous segment, from where it got
+    std::array<std::size_t, 2> arc_axes;        // plane, counterclockwise is from the first axis towards the second
+    std::array<int32_t, 2> arc_start;           // half pulses from the center
+    std::array<int8_t, 2> arc_signs;            // directions of the plane axes, signed as the counts
+    uint32_t arc_radius;                        // half pulses
+};
+
+/**
+ * @class   planner
+ * @brief   look-ahead queue of the segments of a path.
+ * @details Every time a segment is added, the speed at each junction is
+ *          limited by the angle between the segments (junction deviation),
+ *          and the entry speeds are replanned with a backward pass, so the
+ *          path can always stop at its end, and a forward pass, so no
+ *          segment is entered faster than it can be reached.
+ *          The axis task pushes at the tail and the step ISR advances the
+ *          head. The segment at the head is the one being stepped.
+ */
+template <std::size_t N> class planner {
+  public:
+    static constexpr uint32_t SEGMENTS = 16; // must be a power of two
+
+    planner() = default;
+
+    void clear() {
+        head = tail.load();
+    }
+
+    bool is_empty() const {
+        return head == tail;
+    }
+
+    bool is_full() const {
+        return tail - head >= SEGMENTS;
+    }
+
+    bool has_next() const {
+        return tail - head > 1;
+    }
+
+    segment<N> &current() {
+        return segments[head % SEGMENTS];
+    }
+
+    segment<N> const &next() const {
+        return segments[(head + 1) % SEGMENTS];
+    }
+
+    segment<N> const &back() const {
+        return segments[(tail - 1) % SEGMENTS];
+    }
+
+    float exit_speed() const;
+
+    bool push(segment<N> const &seg);
+
+    void advance();
+
+    void recalculate();
+
+    void publish();
+
+  public:
+    float acceleration = 2000;     // counts/s^2
+    float jerk = 20000;            // counts/s^3, 0 for trapezoidal profiles
+    float junction_deviation = 10; // counts
+
+  private:
+    float junction_speed(segment<N> const &prev, segment<N> const &next) const;
+
+    std::array<segment<N>, SEGMENTS> segments;
+    std::array<float, SEGMENTS> planned = {}; // entry speeds, by recalculate() for publish()
+    uint32_t planned_last = 0;                // tail when they were planned
+    std::atomic<uint32_t> head = 0;
+    std::atomic<uint32_t> tail = 0;
+
+    planner(planner const &) = delete;
+    void operator=(planner const &) = delete;
+};
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @class   profile
+ * @brief   velocity profile generator for the leader axis of a segment.
+ * @details Advanced once per timer tick from the step ISR, it ramps the step
+ *          frequency up to max_freq, cruises, and starts decelerating as soon
+ *          as the distance left is the one needed to reach the exit frequency.
+ *          With jerk limiting (S-curve) the acceleration itself is ramped;
+ *          with jerk set to 0 the profile is trapezoidal.
+ *          Frequencies are leader step frequencies (steps/s), acceleration is
+ *          in steps/s^2 and jerk in steps/s^3.
+ *          The ISR side works in fixed point on the timer period, following
+ *          AVR446 (D. Austin, "Generate stepper-motor speed profiles in real
+ *          time"): the period is updated incrementally with
+ *          c' = c - 2 c dn / (4 n + 3 dn), where n is the ramp index, the
+ *          ticks needed to reach the current speed from rest at the max
+ *          acceleration, and dn the fraction of the max acceleration being
+ *          applied. Braking distances are differences of ramp indexes.
+ */
+class profile {
+  public:
+    enum phase {
+        ACCEL,
+        CRUISE,
+        DECEL,
+    };
+
+    static constexpr int ACCEL_FRAC_BITS = 24; // acceleration, fraction of the max one
+    static constexpr int RAMP_FRAC_BITS = 8;   // ramp index, ticks
+
+    profile() = default;
+
+    void start(float freq);
+
+    void set_limits(float acceleration, float jerk);
+
+    void set_exit(float exit_freq);
+
+    void rescale(float ratio);
+
+    uint32_t run(uint32_t remaining_ticks);
+
+    /**
+     * @brief   timer counts per tick, to be loaded in the timer
+     */
+    uint32_t get_period() const {
+        return period;
+    }
+
+    float get_freq() const;
+
+    float braking_distance(float exit_freq) const;
+
+  public:
+    uint32_t clock_hz = 0; // the timer clock the periods are counted in
+    float min_freq = 10000;
+    float max_freq = 60000;
+    enum phase phase = ACCEL;
+
+  private:
+    int64_t ramp_of(float tick_rate) const;
+
+    uint32_t period_of(float tick_rate) const;
+
+    uint32_t period = 0;       // current period, timer counts
+    int64_t period_rest = 0;   // remainder of the period divisions, keeps them exact
+    int64_t ramp = 0;          // current ramp index
+    int32_t accel = 0;         // current acceleration
+    uint32_t min_period = 0;   // at max_freq
+    uint32_t max_period = 0;   // at min_freq
+    int64_t max_ramp = 0;      // at max_freq
+    int64_t min_ramp = 0;      // at min_freq
+    uint32_t max_tick_rate = 0;
+    uint32_t exit_period = 0;
+    int64_t exit_ramp = 0;
+    uint32_t exit_tick_rate = 0;
+    uint32_t jerk_time = 0;    // time to ramp the max acceleration in or out, Q16 s. 0 without jerk limiting
+    uint32_t corner_rate = 0;  // tick rate change while ramping the max acceleration out
+    uint64_t jerk_step = 0;    // acceleration change per timer count, Q32
+    float max_accel = 0;
+    float jerk = 0;
+    float exit_freq = 0;
+};
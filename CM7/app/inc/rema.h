@@ -5,8 +5,7 @@
 //#include "encoders_pico.h"
 #include "gpio_templ.h"
 #include "task.h"
-#include "xy_axes.h"
-#include "z_axis.h"
+#include "xyz_axes.h"
 
 #define WATCHDOG_TIME_MS 1000
 
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/**
+ * @class   seqlock
+ * @brief   a value published by one writer task and read by any task without
+ *          taking a lock.
+ * @details The sequence is odd while the value is being written. Readers copy
+ *          the value and retry if the sequence was odd or changed meanwhile.
+ *          The write is done in a critical section, so a reader that
+ *          preempts the writer never finds it half way and spins.
+ * @note    not to be read from ISRs that the critical section doesn't mask
+ */
+template <typename T> class seqlock {
+  public:
+    void write(T const &value) {
+        taskENTER_CRITICAL();
+        uint32_t seq = sequence.load(std::memory_order_relaxed);
+        sequence.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+        data = value;
+        sequence.store(seq + 2, std::memory_order_release);
+        taskEXIT_CRITICAL();
+    }
+
+    T read() const {
+        T value;
+        uint32_t before, after;
+        do {
+            before = sequence.load(std::memory_order_acquire);
+            value = data;
+            std::atomic_thread_fence(std::memory_order_acquire);
+            after = sequence.load(std::memory_order_relaxed);
+        } while ((before & 1) || before != after);
+        return value;
+    }
+
+    /**
+     * @returns the number of values written so far
+     */
+    uint32_t writes() const {
+        return sequence.load(std::memory_order_acquire) >> 1;
+    }
+
+  private:
+    std::atomic<uint32_t> sequence = 0;
+    T data = {};
+};
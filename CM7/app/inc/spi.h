@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "FreeRTOS.h"
@@ -14,6 +15,12 @@ extern "C" {
 
 inline SemaphoreHandle_t encoders_mutex;
 
+#ifdef SIMULATION
+// Frames go to the Pico emulator of the host simulation, see sim/inc/pico_emulator.h
+void sim_spi_write(void const *buf, size_t len);
+void sim_spi_read(void *buf, size_t len);
+#endif
+
 /**
  * \brief 	initializes SSP bus to transfer SPI frames as a MASTER.
  * @returns	noting
@@ -76,10 +83,13 @@ static inline void spi_de_init(void) {
  * @return    0 on success
  * @note     This function writes the buffer buf.
  */
-static inline int spi_write(void *buf, size_t len, void (*cs)(bool)) {
+static inline int spi_write([[maybe_unused]]void *buf, [[maybe_unused]]size_t len, [[maybe_unused]]void (*cs)(bool)) {
     /* @formatter:off */
     // Chip_SSP_DATA_SETUP_T t = { .tx_data = buf, .length = static_cast<uint32_t>(len) };
     /* @formatter:on */
+#ifdef SIMULATION
+    sim_spi_write(buf, len);
+#endif
     return 1; //spi_sync_transfer(&t, cs);
 }
 
@@ -94,6 +104,9 @@ static inline int spi_read([[maybe_unused]]void *buf, [[maybe_unused]]size_t len
     /* @formatter:off */
     // Chip_SSP_DATA_SETUP_T t = { .rx_data = buf, .length = static_cast<uint32_t>(len) };
     /* @formatter:on */
+#ifdef SIMULATION
+    sim_spi_read(buf, len);
+#endif
     return 1; //spi_sync_transfer(&t, cs);
 }
 
@@ -0,0 +1,75 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * @class   spsc_ring
+ * @brief   fixed capacity, statically allocated ring of values for a single
+ *          producer and a single consumer.
+ * @details The producer only writes the tail and the consumer only writes the
+ *          head, so no locks are needed. An element is published by the
+ *          increment of the tail that follows its copy, and freed by the
+ *          increment of the head.
+ */
+template <typename T, uint32_t SIZE> class spsc_ring {
+    static_assert((SIZE & (SIZE - 1)) == 0, "SIZE must be a power of two");
+
+  public:
+    spsc_ring() = default;
+
+    bool is_empty() const {
+        return head == tail;
+    }
+
+    bool is_full() const {
+        return tail - head >= SIZE;
+    }
+
+    /**
+     * @brief   copies an element at the tail
+     * @returns false if the ring is full
+     * @note    producer side
+     */
+    bool push(T const &value) {
+        if (is_full()) {
+            return false;
+        }
+        elements[tail % SIZE] = value;
+        tail++;
+        return true;
+    }
+
+    /**
+     * @brief   oldest element, left in the ring
+     * @returns nullptr if the ring is empty
+     * @note    consumer side
+     */
+    T const *front() const {
+        return is_empty() ? nullptr : &elements[head % SIZE];
+    }
+
+    /**
+     * @brief   moves the oldest element out of the ring
+     * @returns false if the ring is empty
+     * @note    consumer side
+     */
+    bool pop(T &value) {
+        if (is_empty()) {
+            return false;
+        }
+        value = elements[head % SIZE];
+        head++;
+        return true;
+    }
+
+  private:
+    std::array<T, SIZE> elements;
+    std::atomic<uint32_t> head = 0;
+    std::atomic<uint32_t> tail = 0;
+
+    spsc_ring(spsc_ring const &) = delete;
+    void operator=(spsc_ring const &) = delete;
+};
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+#include "board.h"
+
+/**
+ * @struct  step_schedule
+ * @brief   double buffered step schedule: the step edges and the timer
+ *          period of every tick, for HALF ticks per buffer.
+ * @details Entry i is output on the update event that starts tick i: bsrr[i]
+ *          is written to the BSRR of the step port, and periods[i] to the
+ *          preloaded ARR, so it sets the length of the tick after it, as the
+ *          step ISR does with tmr::set_period().
+ *          The edges and the periods are kept in separate arrays because each
+ *          one is moved by its own DMA stream. Both halves are aligned to
+ *          the cache lines, so that each one can be cleaned on its own.
+ */
+template <uint32_t HALF> struct step_schedule {
+    static_assert(HALF % 8 == 0, "a half must be made of whole cache lines");
+
+    static constexpr uint32_t SIZE = 2 * HALF;
+
+    alignas(32) std::array<uint32_t, SIZE> bsrr;
+    alignas(32) std::array<uint32_t, SIZE> periods;
+};
+
+/**
+ * @class   step_dma
+ * @brief   outputs a step schedule from the update events of the step timer,
+ *          without interrupting the CPU on every tick.
+ * @details Two DMA streams run in circular mode on the whole schedule: one
+ *          is requested by the timer update event and writes the step port
+ *          BSRR, the other by the compare 1 event, which happens right after
+ *          it with CCR1 = 0, and writes ARR. The streams interrupt when they
+ *          are done with each half, so that it is refilled while the other
+ *          half is being output.
+ */
+class step_dma {
+  public:
+    enum half {
+        FIRST,
+        SECOND,
+        NONE,
+    };
+
+    static constexpr uint32_t HALF_TRANSFER = 1 << 0;     // HTIF
+    static constexpr uint32_t TRANSFER_COMPLETE = 1 << 1; // TCIF
+
+    step_dma() = default;
+
+    void start(GPIO_TypeDef *port, uint32_t const *bsrr, uint32_t const *periods, uint32_t count);
+
+    void stop();
+
+    bool is_started() const {
+        return started;
+    }
+
+    enum half completed_half();
+
+  public:
+    GPIO_TypeDef *port = nullptr;
+    uint32_t const *bsrr = nullptr;
+    uint32_t const *periods = nullptr;
+    uint32_t count = 0;
+    volatile uint32_t next = 0;  // entry moved on the next request, count - NDTR
+    volatile uint32_t flags = 0; // interrupt flags of the streams
+
+  private:
+    bool started = false;
+};
@@ -0,0 +1,85 @@
+#pragma once
+
+#include <cstdint>
+
+/**
+ * @class   stepgen
+ * @brief   velocity profile of an axis moved on its own, in the independent
+ *          mode of the interpolator.
+ * @details The interpolator ticks at a fixed rate and steps the axis from a
+ *          DDA whose increment is the speed given by update() over that rate.
+ *          Every update ramps the speed towards max_speed at the acceleration,
+ *          or down as soon as the distance ahead is the one needed to stop,
+ *          trapezoidal. The speed never exceeds the one that would cover the
+ *          distance ahead before the next update, so the axis stops on its
+ *          target.
+ *          Positions are in half pulses, signed as the counts of the axis,
+ *          speeds in half pulses/s and the acceleration in half pulses/s^2.
+ *          While jogging there is no target: the speed is ramped towards the
+ *          jog velocity instead, at the same acceleration.
+ *          The direction is the one of the axis: a target behind it, or a
+ *          jog velocity the other way, is approached by stopping, and
+ *          waiting in reversing() for the direction to be changed. It is
+ *          only reported after a whole update without steps, so none in the
+ *          old direction is still waiting to be output by the DMA.
+ * @note    update() is called from the step ISR, the rest with it masked
+ */
+class stepgen {
+  public:
+    void start(float speed) {
+        this->speed = speed;
+    }
+
+    float update(int32_t position, int sign, float dt);
+
+    /**
+     * @returns where the axis has to go, signed as the counts: the distance
+     *          to the target, or the sign of the jog velocity while jogging
+     */
+    int32_t heading(int32_t position) const {
+        if (jogging) {
+            return jog_velocity < 0 ? -1 : 1;
+        }
+        return target - position;
+    }
+
+    /**
+     * @returns the half pulses the axis travels until it stops, at the
+     *          acceleration
+     */
+    int32_t stopping_distance() const {
+        return static_cast<int32_t>(speed * speed / (2 * acceleration));
+    }
+
+    /**
+     * @returns true if the axis stopped because the target is behind it
+     */
+    bool reversing() const {
+        return is_reversing;
+    }
+
+    bool is_stopped() const {
+        return speed == 0;
+    }
+
+    /**
+     * @returns true if the axis was jogged to a stop
+     */
+    bool is_jog_finished() const {
+        return jogging && !jog_velocity && !speed;
+    }
+
+  public:
+    int32_t target = 0; // half pulses
+    float speed = 0;
+    float min_speed = 0; // the axis starts and stops at it
+    float max_speed = 0;
+    float acceleration = 0;
+    bool jogging = false;
+    float jog_velocity = 0; // half pulses/s, signed as the counts
+
+  private:
+    float update_jog(int sign, float dt);
+
+    bool is_reversing = false;
+};
@@ -1,21 +1,154 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
 
+#include "FreeRTOS.h"
+
 #include "bresenham.h"
 //#include "encoders_pico.h"
 
+#define TCP_SERVER_MAX_SERVERS 3    // listening sockets
+#define TCP_SERVER_SLOTS       5    // client connections, of all the servers together. See MEMP_NUM_NETCONN
+#define TCP_SERVER_TX_SIZE     512  // bytes
+#define TCP_SERVER_POLL_MS     10   // the servers are polled at least this often
+
+#define TCP_SERVER_TASK_PRIORITY (configMAX_PRIORITIES - 4) // below the axes and the encoders tasks
+
+class tcp_server;
+
+/**
+ * @struct  tcp_connection
+ * @brief   slot of a client connection of the network task.
+ * @details A FREE slot is taken by the next client accepted. READY
+ *          connections are waited on for input, and SENDING ones for room
+ *          to send their pending output too. Output is queued with write(),
+ *          or with write_lent() for a buffer too large for the slot, and
+ *          sent as the socket takes it, without blocking the other clients.
+ *          Input is reassembled in the rx_buffer the server lends the
+ *          connection, until a whole message is there.
+ */
+struct tcp_connection {
+    enum class state { FREE, READY, SENDING };
+
+    bool write(void const *data, std::size_t len);
+
+    bool write_lent(char const *data, std::size_t len);
+
+    bool is_sending() const {
+        return conn_state == state::SENDING;
+    }
+
+    enum state conn_state = state::FREE;
+    int sock = -1;
+    tcp_server *server = nullptr;
+    std::size_t slot = 0;      // index among the connections of the server, by accept_client()
+    char *rx_buffer = nullptr; // the one of the slot, none if the server takes no input
+    std::size_t rx_len = 0;
+    bool rx_discarding = false; // the rest of a message too long for rx_buffer
+    char tx_buffer[TCP_SERVER_TX_SIZE];
+    char const *tx_lent = nullptr; // buffer of the server being sent instead of tx_buffer
+    std::size_t tx_len = 0;
+    std::size_t tx_sent = 0;
+};
+
+/**
+ * @class   tcp_server
+ * @brief   TCP service of one port, served by the network task.
+ * @details The network task multiplexes the listening sockets of all the
+ *          servers and the connections of their clients with lwip_select(),
+ *          so there is one task and one stack for all of them. Each server
+ *          takes up to max_connections of the TCP_SERVER_SLOTS slots.
+ *          Servers don't block: they are told of the messages of their
+ *          connections by receive(), and polled at least every
+ *          TCP_SERVER_POLL_MS for their periodic output.
+ *          Messages are framed by frame(), by default they end with a
+ *          newline or a null character, and may come fragmented or several
+ *          in one segment. The servers that take
+ *          input give a reassembly buffer of rx_size bytes for each of
+ *          their connections, the input of the others is discarded. A
+ *          message is passed as soon as it is whole, while the connection
+ *          has no output pending, so pipelined ones are answered in order.
+ *          The first server created starts the network task.
+ */
 class tcp_server {
   public:
-    explicit tcp_server(const char *name, int port);
+    explicit tcp_server(const char *name,
+                        int port,
+                        int max_connections = 1,
+                        char *rx_buffers = nullptr,
+                        std::size_t rx_size = 0);
 
     virtual ~tcp_server() {
     } // Virtual destructor
 
-    virtual void reply_fn(int sock) = 0;
+    static constexpr std::size_t FRAME_ERROR = SIZE_MAX;
+
+    /**
+     * @brief   called with every message of a connection, as framed by
+     *          frame()
+     */
+    virtual void receive(tcp_connection &conn, char *data, int len) {
+    }
+
+    virtual std::size_t frame(char *data, std::size_t len, std::size_t &message_len);
+
+    /**
+     * @brief   called from the network task at least every
+     *          TCP_SERVER_POLL_MS
+     */
+    virtual void poll() {
+    }
 
-    void task();
+    /**
+     * @brief   called before the socket of a connection is closed, by the
+     *          client or on an error
+     */
+    virtual void closing(tcp_connection &conn) {
+    }
+
+    template <typename F> void for_each_connection(F fn) {
+        for (tcp_connection &conn : connections) {
+            if (conn.server == this && conn.conn_state != tcp_connection::state::FREE) {
+                fn(conn);
+            }
+        }
+    }
+
+    int connections_count();
+
+    /**
+     * @returns the index of a connection among the ones of the server, the
+     *          one of its rx buffer, so that the server may keep more state
+     *          for each of them
+     */
+    std::size_t slot_of(tcp_connection const &conn) const {
+        return conn.slot;
+    }
 
     const char *name;
     int port;
+    int max_connections;
+    char *rx_buffers;   // max_connections of rx_size bytes
+    std::size_t rx_size;
+
+  private:
+    static void task();
+
+    static void start_listening(tcp_server *server);
+
+    static void accept_client(tcp_server *server);
+
+    static void read_input(tcp_connection &conn);
+
+    static void take_messages(tcp_connection &conn);
+
+    static void flush(tcp_connection &conn);
+
+    static void close_connection(tcp_connection &conn);
+
+    int listen_sock = -1;
+
+    static tcp_server *servers[TCP_SERVER_MAX_SERVERS];
+    static tcp_connection connections[TCP_SERVER_SLOTS];
 };
@@ -1,6 +1,8 @@
 #pragma once
 
+#include <cstddef>
 #include <cstdint>
+#include <cstring>
 
 #include "FreeRTOS.h"
 #include "task.h"
@@ -10,71 +12,79 @@
 #include "lwip/sys.h"
 #include "lwip/netdb.h"
 
-#include "arduinojson_cust_alloc.h"
+#include "command_protocol.h"
 #include "debug.h"
 #include "rema.h"
 #include "tcp_server.h"
 #include <cerrno>
-#include "xy_axes.h"
-#include "z_axis.h"
-
-namespace json = ArduinoJson;
-
-class tcp_server_command : public tcp_server {
+#include "xyz_axes.h"
+
+#define COMMAND_MAX_CONNECTIONS 1
+#define COMMAND_RX_SIZE         4096 // bytes, the longest batch of commands and its delimiter
+#define COMMAND_TX_SIZE         4096 // bytes, the longest answer
+
+/**
+ * @class   tcp_server_command
+ * @brief   the command server, there is one. Its rx and tx buffers and the
+ *          arena of command_protocol, about 24 KB, are static storage, so it
+ *          may be created with new without taking them from the FreeRTOS heap
+ */
+class tcp_server_command : public tcp_server, public command_protocol {
   public:
-    tcp_server_command(int port) : tcp_server("command", port) {
+    tcp_server_command(int port)
+        : tcp_server("command", port, COMMAND_MAX_CONNECTIONS, rx_buffers[0], sizeof(rx_buffers[0])) {
+    }
+
+    /**
+     * @details The documents of the batch and of its answer are allocated
+     *          from the arena, reset once the answer is serialized into the
+     *          tx buffer of the connection, so no heap is used. The next
+     *          message of the connection isn't taken until it is sent.
+     */
+    void receive(tcp_connection &conn, char *data, int len) override {
+        // rema::update_watchdog_timer();
+
+        json::ArenaScope scope(arena);
+        char *tx_buffer = tx_buffers[slot_of(conn)];
+        int ack_len;
+
+        if (static_cast<uint8_t>(data[0]) == BIN_MAGIC) {
+            ack_len = bin_wp(data, len, tx_buffer, sizeof(tx_buffers[0]));
+        } else {
+            lDebug_uart_semihost(Info, "Command received %s", data);
+            ack_len = json_wp(data, tx_buffer, sizeof(tx_buffers[0]));
+        }
+
+        // lDebug_uart_semihost(Info, "To send %d bytes: %s", ack_len, tx_buffer);
+
+        if (ack_len > 0) {
+            conn.write_lent(tx_buffer, ack_len);
+        }
     }
 
-    static bresenham *get_axes(const char *axis);
-
-    void reply_fn(int sock) override {
-        int len;
-        char rx_buffer[1024];
-
-        do {
-            len = lwip_recv(sock, rx_buffer, sizeof(rx_buffer) - 1, 0);
-            if (len < 0) {
-                lDebug(Error, "Error occurred during receiving command: errno %d", errno);
-                return;
-            } else if (len == 0) {
-                lDebug(Warn, "Command connection closed");
-                return;
-            } else {
-                // rema::update_watchdog_timer();
-                rx_buffer[len] = 0; // Null-terminate whatever is received and treat it like a string
-                lDebug_uart_semihost(Info, "Command received %s", rx_buffer);
-
-                char *tx_buffer;
-
-                int ack_len = json_wp(rx_buffer, &tx_buffer);
-
-                // lDebug_uart_semihost(Info, "To send %d bytes: %s", ack_len, tx_buffer);
-
-                if (ack_len > 0) {
-                    // send() can return less bytes than supplied length.
-                    // Walk-around for robust implementation.
-                    int to_write = ack_len;
-
-                    while (to_write > 0) {
-                        int written = lwip_send(sock, tx_buffer + (ack_len - to_write), to_write, 0);
-                        if (written < 0) {
-                            lDebug(Error, "Error occurred during sending command: errno %d", errno);
-                            if (tx_buffer) {
-                                delete[] tx_buffer;
-                                tx_buffer = NULL;
-                            }
-                            return;         // Returning here will recreate the socket
-                        }
-                        to_write -= written;
-                    }
-
-                    if (tx_buffer) {
-                        delete[] tx_buffer;
-                        tx_buffer = NULL;
-                    }
-                }
-            }
-        } while (len > 0);
+    /**
+     * @brief   frames the binary messages by the length in their header, and
+     *          the JSON ones by their delimiter
+     */
+    std::size_t frame(char *data, std::size_t len, std::size_t &message_len) override {
+        if (!len || static_cast<uint8_t>(data[0]) != BIN_MAGIC) {
+            return tcp_server::frame(data, len, message_len);
+        }
+
+        if (len < sizeof(bin_header)) {
+            return 0; // not whole yet
+        }
+        bin_header header;
+        memcpy(&header, data, sizeof(header));
+        std::size_t total = sizeof(header) + header.length;
+        if (total > rx_size - 1) {
+            return FRAME_ERROR; // would never fit, and the rest can't be framed without it
+        }
+        if (len < total) {
+            return 0;
+        }
+        message_len = total;
+        return total;
     }
 
     json::MyJsonDocument logs_cmd(json::JsonObject const pars);
@@ -91,15 +101,20 @@ class tcp_server_command : public tcp_server {
     json::MyJsonDocument mem_info_cmd(json::JsonObject const pars);
     json::MyJsonDocument temperature_info_cmd(json::JsonObject const pars);
     json::MyJsonDocument move_closed_loop_cmd(json::JsonObject const pars);
+
+    json::MyJsonDocument move_independent_cmd(json::JsonObject const pars);
+
+    json::MyJsonDocument jog_velocity_cmd(json::JsonObject const pars);
     json::MyJsonDocument move_joystick_cmd(json::JsonObject const pars);
     json::MyJsonDocument move_incremental_cmd(json::JsonObject const pars);
+    json::MyJsonDocument arc_cmd(json::JsonObject const pars);
     json::MyJsonDocument brakes_mode_cmd(json::JsonObject const pars);
     json::MyJsonDocument touch_probe_cmd(json::JsonObject const pars);
     json::MyJsonDocument read_encoders_cmd(json::JsonObject const pars);
     json::MyJsonDocument read_limits_cmd(json::JsonObject const pars);
-    json::MyJsonDocument cmd_execute(char const *cmd, json::JsonObject const pars);
-
-    int json_wp(char *rx_buff, char **tx_buff);
+    json::MyJsonDocument profile_cmd(json::JsonObject const pars);
+    using command_protocol::cmd_execute;
+    json::MyJsonDocument cmd_execute(std::size_t opcode, json::JsonObject const pars) override;
 
     // FredMemFn points to a member of Fred that takes (char,float)
     typedef json::MyJsonDocument (tcp_server_command::*cmd_function_ptr)(json::JsonObject pars);
@@ -110,4 +125,8 @@ class tcp_server_command : public tcp_server {
     } cmd_entry;
 
     static const cmd_entry cmds_table[];
+
+  private:
+    static inline char rx_buffers[COMMAND_MAX_CONNECTIONS][COMMAND_RX_SIZE];
+    static inline char tx_buffers[COMMAND_MAX_CONNECTIONS][COMMAND_TX_SIZE];
 };
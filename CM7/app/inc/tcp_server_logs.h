@@ -17,42 +17,32 @@
 #include "rema.h"
 #include "tcp_server.h"
 #include "temperature_ds18b20.h"
-#include "xy_axes.h"
-#include "z_axis.h"
+#include "xyz_axes.h"
 
 namespace json = ArduinoJson;
 
+/**
+ * @class   tcp_server_logs
+ * @brief   sends the network debug messages to all its clients. A client
+ *          without room for a message misses it
+ */
 class tcp_server_logs : public tcp_server {
   public:
-    tcp_server_logs(int port) : tcp_server("logs", port) {
+    tcp_server_logs(int port, int max_connections = 1) : tcp_server("logs", port, max_connections) {
     }
 
-    void reply_fn(int sock) override {
-        while (true) {           
-            char *debug_msg;  
-                if (xQueueReceive(debug_queue, &debug_msg, portMAX_DELAY) == pdPASS) {
-                size_t msg_len = strlen(debug_msg);
-
-                if (msg_len > 0) {                    
-                    msg_len++;
-                    //lDebug_uart_semihost(Info, "To send %d bytes: %s", msg_len, debug_msg);
-                    
-                    // send() can return less bytes than supplied length.
-                    // Walk-around for robust implementation.
-                    int to_write = msg_len;
-                    while (to_write > 0) {
-                        int written = lwip_send(sock, debug_msg + (msg_len - to_write), to_write, 0);
-                        delete[] debug_msg;
-                        debug_msg = nullptr;
-
-                        if (written < 0) {
-                            lDebug_uart_semihost(Error, "Error occurred during sending logs: errno %d", errno);
-                            return;
-                        }
-                        to_write -= written;
-                    }
-                }
+    void poll() override {
+        char *debug_msg;
+        // Kept in the queue while no one is connected
+        while (connections_count() && xQueueReceive(debug_queue, &debug_msg, 0) == pdPASS) {
+            size_t msg_len = strlen(debug_msg);
+
+            if (msg_len > 0) {
+                msg_len++;
+                //lDebug_uart_semihost(Info, "To send %d bytes: %s", msg_len, debug_msg);
+                for_each_connection([&](tcp_connection &conn) { conn.write(debug_msg, msg_len); });
             }
+            delete[] debug_msg;
         }
     }
 };
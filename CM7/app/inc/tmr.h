@@ -17,10 +17,19 @@ class tmr {
 
     void change_freq(uint32_t tick_rate_hz);
 
+    void set_period(uint32_t period);
+
     bool match_pending();
 
+    uint32_t get_clock_hz() const;
+
+    uint32_t get_period() const {
+        return period;
+    }
+
   private:
     bool started;
+    uint32_t period = 0; // timer counts between matches, at twice the step frequency
     //LPC_TIMER_T *lpc_timer;
     //CHIP_RGU_RST_T rgu_timer_rst;
     //CHIP_CCU_CLK_T clk_mx_timer;
@@ -1,7 +0,0 @@
-#pragma once
-
-#include "bresenham.h"
-
-inline bresenham *x_y_axes = nullptr;
-
-bresenham &xy_axes_init();
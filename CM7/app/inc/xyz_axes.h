@@ -0,0 +1,14 @@
+#pragma once
+
+#include "axis_traits.h"
+#include "bresenham.h"
+
+using x_axis_traits = axis_traits<'X', GPIOB_BASE, GPIO_PIN_1>;
+using y_axis_traits = axis_traits<'Y', GPIOB_BASE, GPIO_PIN_2>;
+using z_axis_traits = axis_traits<'Z', GPIOB_BASE, GPIO_PIN_3, true, true>; // reversed direction and encoder
+
+using xyz_bresenham = bresenham<x_axis_traits, y_axis_traits, z_axis_traits>;
+
+inline xyz_bresenham *x_y_z_axes = nullptr;
+
+xyz_bresenham &xyz_axes_init();
@@ -1,7 +0,0 @@
-#pragma once
-
-#include "bresenham.h"
-
-inline bresenham *z_dummy_axes = nullptr;
-
-bresenham &z_axis_init();
@@ -0,0 +1,42 @@
+#include "alpha_beta.h"
+
+#include "board.h"
+
+/**
+ * @brief   corrects the estimate with a measurement
+ * @param   counts      : the position read from the encoder
+ * @param   timestamp   : DWT cycle counter when it was read
+ */
+void alpha_beta::update(int32_t counts, uint32_t timestamp) {
+    float dt = static_cast<float>(timestamp - state.timestamp) / SystemCoreClock;
+
+    if (reset_requested.exchange(false) || !valid || dt <= 0 || dt > max_interval) {
+        state = { static_cast<float>(counts), 0, timestamp };
+        valid = true;
+    } else {
+        float predicted = state.position + state.velocity * dt;
+        float residual = counts - predicted;
+        state.position = predicted + alpha * residual;
+        if (dt >= min_interval) {
+            state.velocity += beta * residual / dt; // closer measurements would amplify the counts quantization
+        }
+        state.timestamp = timestamp;
+    }
+
+    published.write(state);
+}
+
+/**
+ * @returns the position predicted at a given time
+ * @param   now : DWT cycle counter, e.g. timestamp_counter()
+ */
+float alpha_beta::position(uint32_t now) const {
+    estimate e = published.read();
+    float dt = static_cast<float>(static_cast<int32_t>(now - e.timestamp)) / SystemCoreClock;
+    if (dt < 0) {
+        dt = 0;
+    } else if (dt > max_interval) {
+        dt = max_interval;
+    }
+    return e.position + e.velocity * dt;
+}
@@ -0,0 +1,50 @@
+#include "arcgen.h"
+
+#include <cmath>
+
+/**
+ * @brief   starts an arc, the error is taken against the given radius so a
+ *          start a little off the circle is brought back onto it
+ * @param   from    : half pulses from the center
+ * @param   radius  : half pulses
+ * @param   axes    : indexes in the interpolator of the axes of the plane
+ */
+void arcgen::start(std::array<int32_t, 2> from, uint32_t radius, std::array<std::size_t, 2> axes) {
+    pos = from;
+    error = static_cast<int64_t>(from[0]) * from[0] + static_cast<int64_t>(from[1]) * from[1] -
+            static_cast<int64_t>(radius) * radius;
+    masks = { uint32_t(1) << axes[0], uint32_t(1) << axes[1] };
+    signs = {};
+
+    shift = 0;
+    while ((radius >> shift) >= (uint32_t(1) << 15)) {
+        shift++;
+    }
+    scaled_radius = radius >> shift;
+}
+
+/**
+ * @returns the ticks step() takes to go from one point of the arc to
+ *          another one of the same quadrant: the half pulses of the axis
+ *          stepping on every tick, on each side of the diagonal
+ * @note    the points may be off by a few half pulses of the ones step()
+ *          goes through, so may be the ticks
+ */
+uint32_t arcgen::ticks(std::array<int32_t, 2> from, std::array<int32_t, 2> to, uint32_t radius) {
+    auto x_steps = [](std::array<int32_t, 2> const &p) { return std::abs(p[0]) < std::abs(p[1]); };
+    auto run = [](std::array<int32_t, 2> const &a, std::array<int32_t, 2> const &b, bool along_x) {
+        std::size_t i = along_x ? 0 : 1;
+        return static_cast<uint32_t>(std::abs(static_cast<int64_t>(b[i]) - a[i]));
+    };
+
+    if (x_steps(from) == x_steps(to)) {
+        return run(from, to, x_steps(from));
+    }
+
+    int32_t corner = lround(radius * M_SQRT1_2);
+    std::array<int32_t, 2> diagonal = {
+        (static_cast<int64_t>(from[0]) + to[0] < 0) ? -corner : corner,
+        (static_cast<int64_t>(from[1]) + to[1] < 0) ? -corner : corner,
+    };
+    return run(from, diagonal, x_steps(from)) + run(diagonal, to, x_steps(to));
+}
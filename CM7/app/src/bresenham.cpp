@@ -1,73 +1,129 @@
 #include "mot_pap.h"
 
 #include <algorithm>
+#include <cmath>
 #include <cstdint>
 #include <cstdlib>
 
-#include "queue.h"
 #include "task.h"
 
 #include "bresenham.h"
+#include "cycles.h"
 #include "../inc/debug.h"
 #include "rema.h"
+#include "xyz_axes.h"
 
-void bresenham::task() {
-    struct bresenham_msg *msg_rcv;
+template <typename... Axes> void bresenham<Axes...>::task() {
+    struct bresenham_msg<N> msg;
 
     while (true) {
-        if (xQueueReceive(queue, &msg_rcv, portMAX_DELAY) == pdPASS) {
+        ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+        while (true) {
+            if (hard_stop_requested) {
+                finish_hard_stop();
+            }
+
+            if (!commands.pop(msg)) {
+                break;
+            }
+
+            // Joystick setpoints and jog velocities replace each other, only
+            // the latest pending one of each axis is applied
+            bresenham_msg<N> next;
+            while ((msg.type == mot_pap::type::MOVE_JOYSTICK || msg.type == mot_pap::type::JOG_VELOCITY) &&
+                   commands.front() && commands.front()->type == msg.type) {
+                commands.pop(next);
+                commands_done++;
+                for (std::size_t i = 0; i < N; i++) {
+                    if (next.named & (1 << i)) {
+                        msg.setpoints[i] = next.setpoints[i];
+                    }
+                }
+                msg.named |= next.named;
+            }
+
             lDebug(Info, "%s: command received", name);
 
-            switch (msg_rcv->type) {
+            switch (msg.type) {
             case mot_pap::type::MOVE:
+                if (append(msg.setpoints)) {
+                    break;
+                }
+                [[fallthrough]]; // not moving, start a new path
+
+            case mot_pap::type::MOVE_JOYSTICK:
                 vTaskSuspend(supervisor_task_handle);
                 was_stopped_by_probe = false;
                 was_stopped_by_probe_protection = false;
                 was_soft_stopped = false;
-                move(msg_rcv->first_axis_setpoint, msg_rcv->second_axis_setpoint);
+                move(msg.setpoints);
                 vTaskResume(supervisor_task_handle);
                 break;
 
-            case mot_pap::type::SOFT_STOP:
-                if (is_moving) {
-                    int x2 = kp.out_max;
-                    int x1 = kp.out_min;
-                    int y2 = 1000;
-                    int y1 = 200;
-                    int x = current_freq;
-                    int y = ((static_cast<float>(y2 - y1) / (x2 - x1)) * (x - x1)) + y1;
-
-                    int counts = y;
-                    lDebug(Info, "Soft stop %s in %i counts", name, counts);
+            case mot_pap::type::ARC:
+                if (append_arc(msg.setpoints, msg.arc)) {
+                    break;
+                }
+                vTaskSuspend(supervisor_task_handle);
+                was_stopped_by_probe = false;
+                was_stopped_by_probe_protection = false;
+                was_soft_stopped = false;
+                move_arc(msg.setpoints, msg.arc);
+                vTaskResume(supervisor_task_handle);
+                break;
 
-                    int first_axis_setpoint = first_axis->current_counts;
-                    int second_axis_setpoint = second_axis->current_counts;
+            case mot_pap::type::MOVE_INDEPENDENT:
+                vTaskSuspend(supervisor_task_handle);
+                was_stopped_by_probe = false;
+                was_stopped_by_probe_protection = false;
+                was_soft_stopped = false;
+                move_independent(msg.setpoints);
+                vTaskResume(supervisor_task_handle);
+                break;
 
-                    if (first_axis->destination_counts > first_axis->current_counts) {
-                        first_axis_setpoint += counts;
-                    }
-                    // DO NOT use "else". If destination_counts() == current_counts
-                    // nothing must be done
-                    if (first_axis->destination_counts < first_axis->current_counts) {
-                        first_axis_setpoint -= counts;
+            case mot_pap::type::JOG_VELOCITY:
+                for (std::size_t i = 0; i < N; i++) {
+                    if (!(msg.named & (1 << i))) {
+                        msg.setpoints[i] = hold_velocity(i);
                     }
+                }
+                jog(msg.setpoints);
+                break;
 
-                    if (second_axis->destination_counts > second_axis->current_counts) {
-                        second_axis_setpoint += counts;
-                    }
-                    // DO NOT use "else". If destination_counts() == current_counts
-                    // nothing must be done
-                    if (second_axis->destination_counts < second_axis->current_counts) {
-                        second_axis_setpoint -= counts;
+            case mot_pap::type::SOFT_STOP:
+                if (is_moving && independent) {
+                    vTaskSuspend(supervisor_task_handle);
+                    was_soft_stopped = true;
+                    soft_stop_independent();
+                    vTaskResume(supervisor_task_handle);
+                } else if (is_moving) {
+                    // Stop along the current segment, in the distance the
+                    // profile needs to slow down to the min frequency
+                    int counts = profile.braking_distance(profile.min_freq) / leader_axis->steps_per_count();
+                    int leader_delta = std::max(static_cast<int>(leader_axis->delta), 1);
+                    lDebug(Info, "Soft stop %s in %i counts", name, counts);
+
+                    std::array<int, N> setpoints;
+                    for (std::size_t i = 0; i < N; i++) {
+                        mot_pap *axis = axes[i];
+                        int axis_counts = static_cast<int64_t>(counts) * axis->delta / leader_delta;
+                        setpoints[i] = axis->current_counts;
+
+                        if (axis->destination_counts > axis->current_counts) {
+                            setpoints[i] += axis_counts;
+                        }
+                        // DO NOT use "else". If destination_counts() == current_counts
+                        // nothing must be done
+                        if (axis->destination_counts < axis->current_counts) {
+                            setpoints[i] -= axis_counts;
+                        }
                     }
 
                     vTaskSuspend(supervisor_task_handle);
                     was_soft_stopped = true;
-                    move(first_axis_setpoint, second_axis_setpoint);
+                    move(setpoints);
                     vTaskResume(supervisor_task_handle);
-
-                    // first_axis->soft_stop(y);
-                    // second_axis->soft_stop(y);
                 }
                 break;
 
@@ -77,40 +133,524 @@ void bresenham::task() {
                 lDebug(Info, "Hard stop %s", name);
                 break;
             }
+            commands_done++;
+        }
+    }
+}
+
+/**
+ * @brief   replans the current segment from the position read from the
+ *          encoders to the destination
+ * @note    the ISR may have started another segment meanwhile, then the
+ *          new DDA parameters are discarded
+ */
+template <typename... Axes> void bresenham<Axes...>::calculate() {
+    uint32_t seq = segment_seq;
+    std::array<int, N> from;
+    std::array<int, N> to;
+    for (std::size_t i = 0; i < N; i++) {
+        from[i] = axes[i]->current_counts;
+        to[i] = axes[i]->destination_counts;
+    }
+
+    segment<N> seg;
+    plan_segment(from, to, seg);
+
+    taskENTER_CRITICAL();
+    bool is_current = (seq == segment_seq);
+    if (is_current) {
+        load_dda(seg);
+    }
+    taskEXIT_CRITICAL();
+
+    if (is_current) {
+        write_encoders_setup();
+    }
+}
+
+/**
+ * @brief   computes the DDA and planner parameters of a straight line
+ * @returns false if the line has no length
+ */
+template <typename... Axes>
+bool bresenham<Axes...>::plan_segment(std::array<int, N> const &from, std::array<int, N> const &to, segment<N> &seg) const {
+    seg.target = to;
+    seg.leader = 0;
+    seg.is_arc = false;
+    seg.arc_continued = false;
+    float length = 0;
+    for (std::size_t i = 0; i < N; i++) {
+        int delta = to[i] - from[i];
+        seg.delta[i] = abs(delta);
+        seg.dir[i] = axes[i]->direction_calculate(delta);
+        length += static_cast<float>(delta) * delta;
+
+        if (seg.delta[i] > seg.delta[seg.leader]) {
+            seg.leader = i;
+        }
+    }
+
+    // Q32 increments, the leader gets exactly DDA_ONE and steps on every tick.
+    // Accumulators start at one half to round the carries to the nearest tick
+    mot_pap *leader = axes[seg.leader];
+    int leader_delta = seg.delta[seg.leader];
+    for (std::size_t i = 0; i < N; i++) {
+        seg.dda_increment[i] = leader_delta ? (static_cast<uint64_t>(seg.delta[i]) << DDA_FRAC_BITS) / leader_delta : 0;
+    }
+    seg.ticks = leader->counts_to_half_pulses(leader_delta);
+
+    if (!leader_delta) {
+        return false;
+    }
+
+    seg.length = sqrtf(length);
+    for (std::size_t i = 0; i < N; i++) {
+        seg.unit[i] = (to[i] - from[i]) / seg.length;
+    }
+    seg.exit_unit = seg.unit;
+
+    seg.freq_per_speed = leader->steps_per_count() * leader_delta / seg.length;
+    seg.nominal_speed = profile.max_freq / seg.freq_per_speed;
+    seg.min_speed = profile.min_freq / seg.freq_per_speed;
+    seg.max_entry_speed = seg.min_speed;
+    seg.entry_speed = seg.min_speed;
+    return true;
+}
+
+/**
+ * @brief   quadrant of a point relative to the center of a counterclockwise
+ *          arc. A point on an axis is in the quadrant the arc goes into
+ */
+static int arc_quadrant(std::array<int, 2> const &p) {
+    if (p[0] > 0 && p[1] >= 0) {
+        return 0;
+    }
+    if (p[0] <= 0 && p[1] > 0) {
+        return 1;
+    }
+    if (p[0] < 0 && p[1] <= 0) {
+        return 2;
+    }
+    return 3;
+}
+
+static int64_t arc_cross(std::array<int, 2> const &a, std::array<int, 2> const &b) {
+    return static_cast<int64_t>(a[0]) * b[1] - static_cast<int64_t>(a[1]) * b[0];
+}
+
+static int64_t arc_dot(std::array<int, 2> const &a, std::array<int, 2> const &b) {
+    return static_cast<int64_t>(a[0]) * b[0] + static_cast<int64_t>(a[1]) * b[1];
+}
+
+/**
+ * @brief   splits an arc at the axes of its plane, so every axis keeps its
+ *          direction along each segment. The other axes stay where they
+ *          are. An arc that ends where it starts is a whole circle
+ * @param   seg     : where each segment is planned, before it is pushed
+ * @param   push    : takes each segment as it is planned, returns false to
+ *                    drop the rest of the arc
+ * @returns the number of segments pushed, 0 if the arc has no radius
+ */
+template <typename... Axes>
+template <typename F>
+std::size_t bresenham<Axes...>::plan_arc(std::array<int, N> const &from,
+                                         std::array<int, N> const &to,
+                                         arc_params const &arc,
+                                         segment<N> &seg,
+                                         F push) const {
+    // Clockwise arcs are walked mirrored, as counterclockwise ones
+    int mirror = arc.clockwise ? -1 : 1;
+    auto relative = [&](std::array<int, N> const &p) -> std::array<int, 2> {
+        return { p[arc.axes[0]] - arc.center[0], (p[arc.axes[1]] - arc.center[1]) * mirror };
+    };
+    auto absolute = [&](std::array<int, 2> const &p) {
+        std::array<int, N> counts = from;
+        counts[arc.axes[0]] = arc.center[0] + p[0];
+        counts[arc.axes[1]] = arc.center[1] + p[1] * mirror;
+        return counts;
+    };
+
+    std::array<int, 2> start = relative(from);
+    std::array<int, 2> end = relative(to);
+    float radius_counts = hypotf(start[0], start[1]);
+    int r = lroundf(radius_counts);
+    if (!r) {
+        return 0;
+    }
+    uint32_t radius = lroundf(radius_counts * 2 * axes[arc.axes[0]]->steps_per_count()); // half pulses
+
+    // Where the arc leaves each quadrant
+    const std::array<std::array<int, 2>, 4> exits = { {
+        { 0, r },
+        { -r, 0 },
+        { 0, -r },
+        { r, 0 },
+    } };
+
+    std::size_t count = 0;
+    std::array<int, 2> p = start;
+    while (count < ARC_SEGMENTS) {
+        int quadrant = arc_quadrant(p);
+        std::array<int, 2> exit = exits[quadrant];
+        bool ends_here = (arc_quadrant(end) == quadrant && arc_cross(p, end) > 0) ||
+                         (arc_cross(exit, end) == 0 && arc_dot(exit, end) > 0);
+        std::array<int, 2> next = ends_here ? end : exit;
+
+        std::array<int, N> segment_to = ends_here ? to : absolute(next);
+        if (plan_arc_segment(absolute(p), segment_to, arc, radius, seg)) {
+            seg.arc_continued = (count > 0);
+            if (!push(seg)) {
+                break;
+            }
+            count++;
+        }
 
-            delete msg_rcv;
-            msg_rcv = nullptr;
+        if (ends_here) {
+            break;
         }
+        p = next;
     }
+    return count;
 }
 
-void bresenham::calculate() {
-    first_axis->delta = abs(first_axis->destination_counts - first_axis->current_counts);
-    second_axis->delta = abs(second_axis->destination_counts - second_axis->current_counts);
+/**
+ * @brief   computes the arcgen and planner parameters of a segment of an
+ *          arc, within a quadrant
+ * @param   radius  : half pulses
+ * @returns false if the segment has no ticks
+ */
+template <typename... Axes>
+bool bresenham<Axes...>::plan_arc_segment(std::array<int, N> const &from,
+                                          std::array<int, N> const &to,
+                                          arc_params const &arc,
+                                          uint32_t radius,
+                                          segment<N> &seg) const {
+    mot_pap const *axis = axes[arc.axes[0]];
+    auto half_pulses = [&](int counts) {
+        return static_cast<int32_t>(static_cast<int64_t>(counts) * axis->motor_resolution / (2 * axis->encoder_resolution));
+    };
+
+    std::array<int32_t, 2> start;
+    std::array<int32_t, 2> end;
+    for (std::size_t k = 0; k < 2; k++) {
+        start[k] = half_pulses(from[arc.axes[k]] - arc.center[k]);
+        end[k] = half_pulses(to[arc.axes[k]] - arc.center[k]);
+    }
+
+    seg.target = to;
+    seg.is_arc = true;
+    seg.arc_continued = false;
+    seg.arc_axes = arc.axes;
+    seg.arc_start = start;
+    seg.arc_radius = radius;
+    seg.ticks = arcgen.ticks(start, end, radius);
+    if (!seg.ticks) {
+        return false;
+    }
+
+    seg.leader = arc.axes[0];
+    for (std::size_t i = 0; i < N; i++) {
+        int delta = to[i] - from[i];
+        seg.delta[i] = abs(delta);
+        seg.dir[i] = axes[i]->direction_calculate(delta);
+        seg.dda_increment[i] = 0;
+        seg.unit[i] = 0;
+        seg.exit_unit[i] = 0;
+        if (seg.delta[i] > seg.delta[seg.leader]) {
+            seg.leader = i;
+        }
+    }
+    for (std::size_t k = 0; k < 2; k++) {
+        int32_t delta = end[k] - start[k];
+        seg.arc_signs[k] = (delta > 0) - (delta < 0);
+        seg.dir[arc.axes[k]] = axes[arc.axes[k]]->direction_calculate(delta);
+    }
+
+    // Tangents, counterclockwise (-y, x), clockwise (y, -x)
+    float sign = arc.clockwise ? -1 : 1;
+    seg.unit[arc.axes[0]] = -sign * start[1] / static_cast<float>(radius);
+    seg.unit[arc.axes[1]] = sign * start[0] / static_cast<float>(radius);
+    seg.exit_unit[arc.axes[0]] = -sign * end[1] / static_cast<float>(radius);
+    seg.exit_unit[arc.axes[1]] = sign * end[0] / static_cast<float>(radius);
+
+    float angle = atan2f(fabsf(static_cast<float>(start[0]) * end[1] - static_cast<float>(start[1]) * end[0]),
+                         static_cast<float>(start[0]) * end[0] + static_cast<float>(start[1]) * end[1]);
+    seg.length = angle * radius / (2 * axis->steps_per_count());
+
+    // A tick is a half pulse of the axis stepping on every tick, stretched to
+    // a half pulse along the arc by arcgen::scale_period()
+    seg.freq_per_speed = axis->steps_per_count();
+    seg.nominal_speed = profile.max_freq / seg.freq_per_speed;
+    seg.min_speed = profile.min_freq / seg.freq_per_speed;
+    seg.max_entry_speed = seg.min_speed;
+    seg.entry_speed = seg.min_speed;
+    return true;
+}
 
-    first_axis->set_direction();
-    second_axis->set_direction();
+/**
+ * @brief   loads the DDA with a segment, and the arcgen with the arcs
+ */
+template <typename... Axes> void bresenham<Axes...>::load_dda(segment<N> const &seg) {
+    leader_axis = axes[seg.leader];
+    for (std::size_t i = 0; i < N; i++) {
+        axes[i]->delta = seg.delta[i];
+        axes[i]->dir = seg.dir[i];
+        dda_increment[i] = seg.dda_increment[i];
+        dda_accumulator[i] = DDA_ONE >> 1;
+    }
 
-    error = first_axis->delta - second_axis->delta;
+    if (seg.is_arc) {
+        if (!seg.arc_continued || !arcgen.active) {
+            arcgen.start(seg.arc_start, seg.arc_radius, seg.arc_axes);
+        }
+        arcgen.set_signs(seg.arc_signs);
+    }
+    arcgen.active = seg.is_arc;
+    ticks_left = seg.ticks;
+}
 
-    if (first_axis->delta > second_axis->delta) {
-        leader_axis = first_axis;
+/**
+ * @brief   starts the next queued segment, without stopping the timer
+ * @note    called from the step ISR. The encoders are given the new targets
+ *          later, by the supervisor task
+ */
+template <typename... Axes> void bresenham<Axes...>::next_segment() {
+    float freq_per_speed = planner.current().freq_per_speed;
+    planner.advance();
+    segment<N> const &seg = planner.current();
+    load_dda(seg);
+    profile.rescale(seg.freq_per_speed / freq_per_speed);
+    load_profile(seg);
+    for (std::size_t i = 0; i < N; i++) {
+        axes[i]->destination_counts = seg.target[i];
+        axes[i]->already_there = (seg.delta[i] == 0);
+    }
+    segment_seq++;
+}
+
+/**
+ * @brief   gives the encoders the targets and directions of the current
+ *          segment, so that they report when it is reached
+ */
+template <typename... Axes> void bresenham<Axes...>::program_encoders() {
+    uint32_t seq = segment_seq;
+    for (mot_pap *axis : axes) {
+        axis->set_destination_counts(axis->destination_counts);
+    }
+    write_encoders_setup();
+    encoder_seq = seq;
+}
+
+/**
+ * @brief   writes the targets and directions of all the axes to the encoders,
+ *          in one transfer if the Pico has the AXES_SETUP block
+ */
+template <typename... Axes> void bresenham<Axes...>::write_encoders_setup() {
+    uint32_t seq = segment_seq;
+    struct axes_setup setup = {};
+    for (std::size_t i = 0; i < N; i++) {
+        mot_pap *axis = axes[i];
+        encoder_directions[i] = axis->encoder_direction();
+        setup.targets[axis->name - 'X'] = axis->encoder_target();
+        setup.directions[axis->name - 'X'] = encoder_directions[i];
+    }
+    setup.threshold = MOT_PAP_POS_THRESHOLD;
+    encoders->write_axes_setup(setup);
+    direction_seq = seq;
+}
+
+/**
+ * @brief   gives the encoders the directions of the segment being stepped,
+ *          the ones that changed at its start, but not its targets: the
+ *          path goes on past them
+ */
+template <typename... Axes> void bresenham<Axes...>::write_directions() {
+    uint32_t seq = segment_seq;
+    for (std::size_t i = 0; i < N; i++) {
+        int32_t direction = axes[i]->encoder_direction();
+        if (direction != encoder_directions[i]) {
+            encoders->set_direction(axes[i]->name, direction);
+            encoder_directions[i] = direction;
+        }
+    }
+    direction_seq = seq;
+}
+
+/**
+ * @brief   gives the profile the acceleration and jerk limits of the path,
+ *          and the exit speed of the segment, as seen by its leader axis
+ */
+template <typename... Axes> void bresenham<Axes...>::load_profile(segment<N> const &seg) {
+    profile.set_limits(planner.acceleration * seg.freq_per_speed, planner.jerk * seg.freq_per_speed);
+    profile.set_exit(planner.exit_speed() * seg.freq_per_speed);
+}
+
+/**
+ * @brief   advances the velocity profile one tick and gives the timer the
+ *          period of the next one
+ * @note    called from the step ISR. The timer is not stopped, the period
+ *          goes through its preload register
+ */
+template <typename... Axes> void bresenham<Axes...>::run_profile() {
+    uint32_t period = next_period();
+    if (period != tmr.get_period()) {
+        tmr.set_period(period);
+    }
+}
+
+/**
+ * @returns the timer period of the next tick: the fixed one in the
+ *          independent mode, the one the velocity profile advances to
+ *          otherwise, stretched along arcs
+ */
+template <typename... Axes> uint32_t bresenham<Axes...>::next_period() {
+    if (independent) {
+        return stepgen_period;
+    }
+    uint32_t period = profile.run(ticks_left);
+    return arcgen.active ? arcgen.scale_period(period) : period;
+}
+
+/**
+ * @brief   clamps the setpoints to half INT32 min and max, so that the
+ *          differences with the current counts never overflow
+ */
+template <std::size_t N> static void clamp_setpoints(std::array<int, N> &setpoints) {
+    for (int &setpoint : setpoints) {
+        setpoint = std::clamp(setpoint, (static_cast<int>(INT32_MIN) / 2), (static_cast<int>(INT32_MAX) / 2));
+    }
+}
+
+/**
+ * @brief   starts a new path from the current position, dropping the
+ *          queued segments, if any
+ */
+template <typename... Axes> void bresenham<Axes...>::move(std::array<int, N> setpoints) {
+    clamp_setpoints(setpoints);
+
+    std::array<int, N> from;
+    float freq_per_speed;
+    if (!begin_path(from, freq_per_speed)) {
+        return;
+    }
+
+    for (std::size_t i = 0; i < N; i++) {
+        lDebug(Info, "MOVE, %c: %i", axes[i]->name, setpoints[i]);
+    }
+
+    segment<N> seg;
+    if (plan_segment(from, setpoints, seg)) {
+        planner.push(seg);
+    }
+    start_path(seg, freq_per_speed);
+}
+
+/**
+ * @brief   starts a new path from the current position along an arc,
+ *          dropping the queued segments, if any
+ */
+template <typename... Axes> void bresenham<Axes...>::move_arc(std::array<int, N> setpoints, arc_params const &arc) {
+    clamp_setpoints(setpoints);
+
+    std::array<int, N> from;
+    float freq_per_speed;
+    if (!begin_path(from, freq_per_speed)) {
+        return;
+    }
+
+    lDebug(Info, "ARC, %c: %i, %c: %i", axes[arc.axes[0]]->name, setpoints[arc.axes[0]], axes[arc.axes[1]]->name, setpoints[arc.axes[1]]);
+
+    // The planner was just cleared, the segments fit
+    segment<N> seg;
+    std::size_t count = plan_arc(from, setpoints, arc, seg, [&](segment<N> const &s) { return planner.push(s); });
+    if (!count && plan_segment(from, setpoints, seg)) {
+        planner.push(seg); // no radius, straight to the end
+    }
+    planner.recalculate();
+    planner.publish(); // not stepping yet
+    start_path(planner.is_empty() ? seg : planner.current(), freq_per_speed);
+}
+
+/**
+ * @brief   stops the stepping to start a new path from the current position,
+ *          dropping the queued segments, if any
+ * @param   from            : filled with the current position
+ * @param   freq_per_speed  : filled with the one of the segment being
+ *                            stepped, 0 if there is none
+ * @returns false if the axes may not move
+ */
+template <typename... Axes> bool bresenham<Axes...>::begin_path(std::array<int, N> &from, float &freq_per_speed) {
+    if (!ready_to_move()) {
+        return false;
+    }
+
+    bool was_moving = is_moving;
+    tmr.stop(); // the ISR mustn't start a queued segment while the path is replaced
+    dma.stop();
+    // The encoders poller checks for stalls while moving, not against the
+    // anchors of the previous path while they are replaced
+    is_moving = false;
+    freq_per_speed = (was_moving && !planner.is_empty()) ? planner.current().freq_per_speed : 0;
+    independent = false;
+    already_there = false;
+    touching_counter = 0;
+    // Read from the bus, the counters may have just been set by set_position()
+    struct encoders_snapshot snapshot = encoders->read_snapshot();
+    for (std::size_t i = 0; i < N; i++) {
+        axes[i]->stall_reset();
+        axes[i]->set_pos_from_encoder(snapshot.counter(axes[i]->name));
+        axes[i]->anchor_commanded();
+        from[i] = axes[i]->current_counts;
+    }
+    planner.clear();
+    is_moving = true;
+    return true;
+}
+
+/**
+ * @brief   starts stepping the path queued after begin_path(), from its
+ *          first segment, unless the axes are already at its end
+ * @param   seg             : the first segment, or the one planned to the
+ *                            current position if the path has no length
+ * @param   freq_per_speed  : as given by begin_path()
+ */
+template <typename... Axes> void bresenham<Axes...>::start_path(segment<N> const &seg, float freq_per_speed) {
+    if (!planner.is_empty()) {
+        if (!freq_per_speed) {
+            profile.start(profile.min_freq);
+        } else {
+            profile.rescale(seg.freq_per_speed / freq_per_speed);
+        }
+        load_profile(seg);
+    }
+    load_dda(seg);
+    for (std::size_t i = 0; i < N; i++) {
+        axes[i]->destination_counts = seg.target[i];
+    }
+    segment_seq++;
+    program_encoders();
+
+    if (std::all_of(axes.begin(), axes.end(), [](mot_pap *axis) { return axis->check_already_there(); })) {
+        already_there = true;
+        stop();
+        lDebug(Info, "%s: already there", name);
     } else {
-        leader_axis = second_axis;
+        start_stepping();
     }
 }
 
-void bresenham::move(int first_axis_setpoint, int second_axis_setpoint) {
-    // Bresenham error calculation needs to multiply by 2 for the error
-    // calculation, thus clamp setpoints to half INT32 min and max
-    first_axis_setpoint =
-        std::clamp(first_axis_setpoint, (static_cast<int>(INT32_MIN) / 2), (static_cast<int>(INT32_MAX) / 2));
-    second_axis_setpoint =
-        std::clamp(second_axis_setpoint, (static_cast<int>(INT32_MIN) / 2), (static_cast<int>(INT32_MAX) / 2));
+/**
+ * @brief   checks that the axes may move, releasing the brakes
+ * @returns false if they may not
+ */
+template <typename... Axes> bool bresenham<Axes...>::ready_to_move() {
+    if (hard_stop_requested) {
+        return false;
+    }
 
     if (!rema::control_enabled_get()) {
         lDebug(Warn, "Trying to move with control disabled");
-        return;
+        return false;
     }
 
     if (has_brakes) {
@@ -118,79 +658,524 @@ void bresenham::move(int first_axis_setpoint, int second_axis_setpoint) {
             rema::brakes_release();
         } else {
             lDebug(Warn, "Trying to move with brakes ON");
-            return;
+            return false;
         }
     }
 
-    is_moving = true;
+    return !hard_stop_requested; // may have been requested while the brakes were being released
+}
+
+/**
+ * @brief   starts the timer, and the step schedule with dma_steps, unless
+ *          the path was stopped meanwhile, e.g. by a stall, or a hard stop
+ *          was requested
+ */
+template <typename... Axes> void bresenham<Axes...>::start_stepping() {
+    ticks_last_time = xTaskGetTickCount();
+    tmr.set_period(independent ? stepgen_period : profile.get_period());
+    sync_step_levels();
+    if (dma_steps) {
+        start_schedule();
+    }
+    taskENTER_CRITICAL();
+    if (is_moving && rema::control_enabled_get() && !hard_stop_requested) {
+        tmr.start();
+    }
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief   sends every axis to its setpoint on its own, in the independent
+ *          mode. The axes already moving in it are retargeted without
+ *          stopping, the rest start from rest or from their speeds along
+ *          the path being followed
+ */
+template <typename... Axes> void bresenham<Axes...>::move_independent(std::array<int, N> setpoints) {
+    clamp_setpoints(setpoints);
+
+    if (!ready_to_move()) {
+        return;
+    }
+
+    bool was_stepping = is_moving && independent;
+    if (was_stepping) {
+        for (mot_pap *axis : axes) {
+            axis->read_pos_from_encoder();
+        }
+    } else {
+        start_independent();
+    }
     already_there = false;
-    first_axis->stall_reset();
-    second_axis->stall_reset();
-    touching_counter = 0;
-    first_axis->read_pos_from_encoder();
-    second_axis->read_pos_from_encoder();
-    first_axis->set_destination_counts(first_axis_setpoint);
-    second_axis->set_destination_counts(second_axis_setpoint);
-    lDebug(Info, "MOVE, %c: %i, %c: %i", first_axis->name, first_axis_setpoint, second_axis->name, second_axis_setpoint);
 
-    calculate();
+    for (std::size_t i = 0; i < N; i++) {
+        mot_pap *axis = axes[i];
+        stepgen &gen = stepgens[i];
+        int32_t target = axis->half_pulses_from_anchor(setpoints[i]);
+        if (gen.is_stopped()) {
+            // The direction first, the old target is where the axis is
+            axis->set_direction(axis->direction_calculate(target - axis->commanded_half_pulses));
+        }
+        taskENTER_CRITICAL();
+        gen.target = target;
+        gen.jogging = false;
+        taskEXIT_CRITICAL();
+        axis->destination_counts = setpoints[i];
+        lDebug(Info, "MOVE_INDEPENDENT, %c: %i", axis->name, setpoints[i]);
+    }
+    segment_seq++;
+    program_encoders();
 
-    if (first_axis->check_already_there() && second_axis->check_already_there()) {
+    if (std::all_of(axes.begin(), axes.end(), [](mot_pap *axis) { return axis->check_already_there(); })) {
         already_there = true;
         stop();
         lDebug(Info, "%s: already there", name);
-    } else {
-        if (!was_soft_stopped) {
-            kp.restart();
-            current_freq = kp.run(leader_axis->destination_counts, leader_axis->current_counts);
-        } else {
-            current_freq = kp.run_unattenuated(leader_axis->destination_counts, leader_axis->current_counts);
+    } else if (!was_stepping) {
+        start_stepping();
+    }
+}
+
+/**
+ * @brief   switches to the independent mode from the current position,
+ *          dropping the path being followed, if any. Its axes keep their
+ *          speeds and directions
+ */
+template <typename... Axes> void bresenham<Axes...>::start_independent() {
+    bool was_moving = is_moving;
+    tmr.stop();
+    dma.stop();
+
+    std::array<float, N> speeds = {};
+    if (was_moving && !independent) {
+        float tick_rate = 2 * profile.get_freq();
+        for (std::size_t i = 0; i < N; i++) {
+            speeds[i] = tick_rate * dda_increment[i] / DDA_ONE;
+        }
+    }
+
+    independent = true;
+    is_moving = false; // see begin_path()
+    touching_counter = 0;
+    planner.clear();
+
+    stepgen_tick_rate = 2 * profile.max_freq;
+    stepgen_period = std::max(static_cast<uint32_t>(lroundf(profile.clock_hz / stepgen_tick_rate)), uint32_t(1));
+    stepgen_ticks = STEPGEN_UPDATE_TICKS - 1; // the stepgens are updated on the first tick
+
+    // Read from the bus, the counters may have just been set by set_position()
+    struct encoders_snapshot snapshot = encoders->read_snapshot();
+    for (std::size_t i = 0; i < N; i++) {
+        mot_pap *axis = axes[i];
+        axis->stall_reset();
+        axis->set_pos_from_encoder(snapshot.counter(axis->name));
+        axis->anchor_commanded();
+
+        float half_pulses_per_count = 2 * axis->steps_per_count();
+        stepgen &gen = stepgens[i];
+        gen.min_speed = 2 * profile.min_freq;
+        gen.max_speed = stepgen_tick_rate;
+        gen.acceleration = planner.acceleration * half_pulses_per_count;
+        gen.target = 0;
+        gen.jogging = false;
+        gen.jog_velocity = 0;
+        gen.start(speeds[i]);
+        dda_increment[i] = 0;
+        dda_accumulator[i] = DDA_ONE >> 1;
+    }
+    is_moving = true;
+}
+
+/**
+ * @brief   jogs the axes at the given velocities, in counts/s. The stepgens
+ *          ramp to them at the acceleration, without stopping the stepping,
+ *          which is only started from the current position if needed
+ */
+template <typename... Axes> void bresenham<Axes...>::jog(std::array<int, N> velocities) {
+    bool was_stepping = is_moving && independent;
+    bool was_jogging = was_stepping && is_jogging();
+    if (!was_stepping) {
+        if (!ready_to_move()) {
+            return;
+        }
+        vTaskSuspend(supervisor_task_handle);
+        was_stopped_by_probe = false;
+        was_stopped_by_probe_protection = false;
+        was_soft_stopped = false;
+        start_independent();
+    }
+
+    taskENTER_CRITICAL();
+    for (std::size_t i = 0; i < N; i++) {
+        stepgens[i].jog_velocity = velocities[i] * 2 * axes[i]->steps_per_count();
+        stepgens[i].jogging = true;
+    }
+    taskEXIT_CRITICAL();
+    last_jog_tick = xTaskGetTickCount();
+
+    if (!was_jogging) {
+        segment_seq++; // the targets of the encoders don't apply while jogging
+        already_there = false;
+        for (mot_pap *axis : axes) {
+            axis->already_there = false;
+        }
+    }
+
+    if (!was_stepping) {
+        for (std::size_t i = 0; i < N; i++) {
+            axes[i]->set_direction(axes[i]->direction_calculate(velocities[i]));
+        }
+        start_stepping();
+        vTaskResume(supervisor_task_handle);
+    }
+}
+
+/**
+ * @brief   true while the axes are being jogged
+ */
+template <typename... Axes> bool bresenham<Axes...>::is_jogging() const {
+    return independent && std::any_of(stepgens.begin(), stepgens.end(), [](stepgen const &gen) { return gen.jogging; });
+}
+
+/**
+ * @brief   true once the axes have been jogged to a stop
+ */
+template <typename... Axes> bool bresenham<Axes...>::is_jog_finished() const {
+    return independent &&
+           std::all_of(stepgens.begin(), stepgens.end(), [](stepgen const &gen) { return gen.is_jog_finished(); });
+}
+
+/**
+ * @brief   advances the stepgens of all the axes, and gives the DDA their
+ *          speeds until the next update
+ * @note    called from the step ISR, or from the DMA one while filling the
+ *          step schedule
+ */
+template <typename... Axes> void bresenham<Axes...>::update_stepgens(BaseType_t *higher_priority_task_woken) {
+    static_assert(STEPGEN_UPDATE_TICKS >= 2 * SCHEDULE_HALF, "the DMA must be done with the steps before a reversal");
+    float dt = STEPGEN_UPDATE_TICKS / stepgen_tick_rate;
+    bool reversing = false;
+    for (std::size_t i = 0; i < N; i++) {
+        mot_pap *axis = axes[i];
+        float speed = stepgens[i].update(axis->commanded_half_pulses, axis->direction_sign(), dt);
+        dda_increment[i] = static_cast<uint64_t>(speed / stepgen_tick_rate * DDA_ONE);
+        reversing |= stepgens[i].reversing();
+    }
+
+    if (reversing) {
+        xSemaphoreGiveFromISR(supervisor_semaphore, higher_priority_task_woken);
+    }
+}
+
+/**
+ * @brief   jogs the axes to a stop if the velocities stopped coming,
+ *          reverses the axes that stopped before a target behind them, and
+ *          gives the ones that stopped on their targets without the encoders
+ *          agreeing the rest of the way, in closed loop
+ * @note    called by the supervisor, in the independent mode
+ */
+template <typename... Axes> void bresenham<Axes...>::supervise_independent() {
+    if (is_jogging() && (xTaskGetTickCount() - last_jog_tick) > pdMS_TO_TICKS(jog_timeout.count())) {
+        taskENTER_CRITICAL();
+        for (stepgen &gen : stepgens) {
+            gen.jog_velocity = 0;
+        }
+        taskEXIT_CRITICAL();
+        last_jog_tick = xTaskGetTickCount();
+        lDebug(Warn, "%s: no jog velocities, stopping", name);
+    }
+
+    for (std::size_t i = 0; i < N; i++) {
+        mot_pap *axis = axes[i];
+        stepgen &gen = stepgens[i];
+        if (gen.reversing()) {
+            axis->set_direction(axis->direction_calculate(gen.heading(axis->commanded_half_pulses)));
+        } else if (gen.is_stopped() && gen.target == axis->commanded_half_pulses && is_final_segment() &&
+                   !axis->check_already_there()) {
+            int32_t target = gen.target + axis->half_pulses_from_anchor(axis->destination_counts) -
+                             axis->half_pulses_from_anchor(axis->current_counts);
+            axis->set_direction(axis->direction_calculate(target - axis->commanded_half_pulses));
+            gen.target = target;
         }
-        lDebug(Debug, "Control output = %i: ", current_freq);
+    }
+}
+
+/**
+ * @brief   stops every axis in the distance its stepgen needs to, in the
+ *          independent mode
+ */
+template <typename... Axes> void bresenham<Axes...>::soft_stop_independent() {
+    for (std::size_t i = 0; i < N; i++) {
+        mot_pap *axis = axes[i];
+        stepgen &gen = stepgens[i];
+        taskENTER_CRITICAL();
+        int32_t target = axis->commanded_half_pulses;
+        if (!gen.reversing()) {
+            target += axis->direction_sign() * gen.stopping_distance();
+        }
+        gen.target = target;
+        gen.jogging = false;
+        taskEXIT_CRITICAL();
+
+        axis->destination_counts = axis->counts_from_anchor(target);
+    }
+    for (mot_pap *axis : axes) {
+        axis->read_pos_from_encoder();
+    }
+    segment_seq++;
+    program_encoders();
+    lDebug(Info, "Soft stop %s", name);
+}
+
+/**
+ * @brief   queues a segment from the end of the path being followed, so that
+ *          it is blended with it
+ * @returns false if there is no path being followed, and a new one must be
+ *          started with move()
+ */
+template <typename... Axes> bool bresenham<Axes...>::append(std::array<int, N> setpoints) {
+    if (!is_moving || independent || was_soft_stopped) {
+        return false;
+    }
 
-        ticks_last_time = xTaskGetTickCount();
-        tmr.change_freq(current_freq);
+    clamp_setpoints(setpoints);
+
+    segment<N> seg;
+    if (!plan_segment(planner.back().target, setpoints, seg)) {
+        return true; // already the end of the path
     }
+    return queue_segment(seg);
+}
+
+/**
+ * @brief   queues an arc from the end of the path being followed, see
+ *          append()
+ * @returns false if there is no path being followed, or it was finished
+ *          before the whole arc was queued. A new one must be started with
+ *          move_arc(), from where the axes are
+ */
+template <typename... Axes> bool bresenham<Axes...>::append_arc(std::array<int, N> setpoints, arc_params const &arc) {
+    if (!is_moving || independent || was_soft_stopped) {
+        return false;
+    }
+
+    clamp_setpoints(setpoints);
+
+    bool queued = true;
+    segment<N> seg;
+    plan_arc(planner.back().target, setpoints, arc, seg, [&](segment<N> const &s) { return queued = queue_segment(s); });
+    return queued;
 }
 
-void bresenham::step() {
-    int error2 = error << 1;
-    if (error2 >= -second_axis->delta) {
-        error -= second_axis->delta;
-        if (!first_axis->check_already_there()) {
-            first_axis->step();
+/**
+ * @brief   adds a segment at the end of the path being followed, waiting
+ *          for room in the planner, and replans the speeds
+ * @returns false if the path was finished meanwhile
+ */
+template <typename... Axes> bool bresenham<Axes...>::queue_segment(segment<N> const &seg) {
+    while (planner.is_full()) {
+        if (!is_moving || hard_stop_requested) {
+            return false;
         }
+        vTaskDelay(pdMS_TO_TICKS(1));
+    }
+
+    // The ISR may finish the path meanwhile
+    taskENTER_CRITICAL();
+    bool appended = is_moving && planner.push(seg);
+    taskEXIT_CRITICAL();
+
+    if (appended) {
+        planner.recalculate();
+
+        // The current segment may have to be left faster now
+        taskENTER_CRITICAL();
+        planner.publish();
+        profile.set_exit(planner.exit_speed() * planner.current().freq_per_speed);
+        taskEXIT_CRITICAL();
+        lDebug(Debug, "%s: segment queued", name);
+    }
+    return appended;
+}
+
+/**
+ * @brief   advances the DDA one tick, stepping every axis whose accumulator
+ *          carries
+ */
+template <typename... Axes> void bresenham<Axes...>::step() {
+    output_steps(step_axes(std::index_sequence_for<Axes...>{}), std::index_sequence_for<Axes...>{});
+}
+
+/**
+ * @returns the masks of the step pins to toggle in this tick, one per axis
+ */
+template <typename... Axes>
+template <std::size_t... I>
+auto bresenham<Axes...>::step_axes(std::index_sequence<I...>) -> std::array<uint32_t, N> {
+    uint32_t arc_steps = arcgen.active ? arcgen.step() : 0;
+    return { step_axis<I>(arc_steps)... };
+}
+
+/**
+ * @param   arc_steps   : mask of the indexes of the axes the arcgen steps
+ * @returns the mask of the step pin of the axis if it has to be toggled
+ */
+template <typename... Axes>
+template <std::size_t I>
+uint32_t bresenham<Axes...>::step_axis(uint32_t arc_steps) {
+    dda_accumulator[I] += dda_increment[I];
+    bool carry = dda_accumulator[I] >= DDA_ONE;
+    if (carry) {
+        dda_accumulator[I] -= DDA_ONE;
+    }
+
+    if ((carry || (arc_steps & (uint32_t(1) << I))) && !axes[I]->check_already_there()) {
+        axes[I]->step();
+        return step_masks[I];
     }
-    if (error2 <= first_axis->delta) {
-        error += first_axis->delta;
-        if (!second_axis->check_already_there()) {
-            second_axis->step();
+    return 0;
+}
+
+/**
+ * @brief   outputs the step pins to toggle with one BSRR write per GPIO
+ *          port, so the axes sharing a port step on the same edge
+ */
+template <typename... Axes>
+template <std::size_t... I>
+void bresenham<Axes...>::output_steps(std::array<uint32_t, N> const &toggles, std::index_sequence<I...>) {
+#ifndef SIMULATE_ENCODER
+    (output_port<I>(toggles), ...);
+#endif
+}
+
+/**
+ * @brief   toggles the step pins of all the axes on the port of the axis,
+ *          if it is the first one on it. The pins state is kept in
+ *          step_levels, so the port is only written and never read
+ */
+template <typename... Axes>
+template <std::size_t I>
+void bresenham<Axes...>::output_port(std::array<uint32_t, N> const &toggles) {
+    if constexpr (is_first_on_port(I)) {
+        uint32_t mask = 0;
+        for (std::size_t i = I; i < N; i++) {
+            if (step_ports[i] == step_ports[I]) {
+                mask |= toggles[i];
+            }
         }
+
+        if (mask) {
+            step_levels[I] ^= mask;
+            reinterpret_cast<GPIO_TypeDef *>(step_ports[I])->BSRR = ((mask & ~step_levels[I]) << 16) | (mask & step_levels[I]);
+        }
+    }
+}
+
+/**
+ * @returns the BSRR word that toggles the step pins, all of them in the port
+ *          of the first axis, for a step schedule entry
+ */
+template <typename... Axes> uint32_t bresenham<Axes...>::step_port_bsrr(std::array<uint32_t, N> const &toggles) {
+    uint32_t mask = 0;
+#ifndef SIMULATE_ENCODER
+    for (uint32_t toggle : toggles) {
+        mask |= toggle;
     }
+#endif
+    step_levels[0] ^= mask;
+    return ((mask & ~step_levels[0]) << 16) | (mask & step_levels[0]);
 }
 
 /**
- * @brief   supervise motor movement for stall or position reached in closed
- * loop
+ * @brief   reads the state of the step pins back from their ports
+ * @note    to be called with the stepping stopped. The step schedule is
+ *          computed ahead of the DMA, when it is stopped the entries left
+ *          were accounted for in step_levels but not output
+ */
+template <typename... Axes> void bresenham<Axes...>::sync_step_levels() {
+    for (std::size_t i = 0; i < N; i++) {
+        if (is_first_on_port(i)) {
+            step_levels[i] = reinterpret_cast<GPIO_TypeDef *>(step_ports[i])->ODR;
+        }
+    }
+}
+
+/**
+ * @brief   computes the ticks of one half of the step schedule. Once the path
+ *          is finished, the rest of the schedule is filled with ticks with
+ *          no steps, and dma_isr() stops when that half has been output
+ * @note    called from the DMA ISR, or from move() before starting it
+ */
+template <typename... Axes>
+void bresenham<Axes...>::fill_schedule(enum step_dma::half half, BaseType_t *higher_priority_task_woken) {
+    uint32_t first = (half == step_dma::FIRST) ? 0 : SCHEDULE_HALF;
+    for (uint32_t i = first; i < first + SCHEDULE_HALF; i++) {
+        if (schedule_end_half == step_dma::NONE && !begin_tick(higher_priority_task_woken)) {
+            schedule_end_half = half;
+        }
+
+        if (schedule_end_half != step_dma::NONE) {
+            schedule.bsrr[i] = 0;
+            schedule.periods[i] = profile.get_period();
+            continue;
+        }
+
+        schedule.bsrr[i] = step_port_bsrr(step_axes(std::index_sequence_for<Axes...>{}));
+        end_tick(higher_priority_task_woken);
+        schedule.periods[i] = next_period();
+    }
+
+    SCB_CleanDCache_by_Addr(&schedule.bsrr[first], SCHEDULE_HALF * sizeof(uint32_t));
+    SCB_CleanDCache_by_Addr(&schedule.periods[first], SCHEDULE_HALF * sizeof(uint32_t));
+}
+
+/**
+ * @brief   computes both halves of the step schedule and hands it to the DMA,
+ *          which starts outputting it with the timer
+ */
+template <typename... Axes> void bresenham<Axes...>::start_schedule() {
+    configASSERT(is_single_port());
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+
+    schedule_end_half = step_dma::NONE;
+    fill_schedule(step_dma::FIRST, &xHigherPriorityTaskWoken);
+    fill_schedule(step_dma::SECOND, &xHigherPriorityTaskWoken);
+    dma.start(reinterpret_cast<GPIO_TypeDef *>(step_ports[0]), schedule.bsrr.data(), schedule.periods.data(), schedule.SIZE);
+}
+
+/**
+ * @brief   stops the axes if the following error of any of them is out of
+ *          its window
+ * @note    called by the encoders poller, right after the observers were
+ *          fed, so a stall trips within one poll
+ */
+template <typename... Axes> void bresenham<Axes...>::check_for_stall() {
+    if (!is_moving || !rema::stall_control) {
+        return;
+    }
+
+    bool stalled = false;
+    for (mot_pap *axis : axes) {
+        stalled |= axis->check_for_stall(); // make sure that all stall checks are executed
+    }
+
+    if (stalled) {
+        stop();
+        rema::control_enabled_set(false);
+    }
+}
+
+/**
+ * @brief   supervise motor movement for touch probe or position reached in
+ * closed loop
  * @returns nothing
  * @note    to be called by the deferred interrupt task handler
  */
-void bresenham::supervise() {
+template <typename... Axes> void bresenham<Axes...>::supervise() {
     while (true) {
         if (xSemaphoreTake(supervisor_semaphore, portMAX_DELAY) == pdPASS) {
+            cycle_scope cycles(supervise_cycles);
 
-            first_axis->read_pos_from_encoder();
-            second_axis->read_pos_from_encoder();
-
-            if (rema::stall_control) {
-                bool first_axis_stalled = first_axis->check_for_stall();   // make sure that both stall
-                bool second_axis_stalled = second_axis->check_for_stall(); // checks are executed
-
-                if (first_axis_stalled || second_axis_stalled) {
-                    stop();
-                    rema::control_enabled_set(false);
-                    continue;
-                }
+            for (mot_pap *axis : axes) {
+                axis->read_pos_from_encoder();
             }
 
             if (rema::touch_probe_protection) {
@@ -215,65 +1200,177 @@ void bresenham::supervise() {
                 continue;
             }
 
-            calculate(); // recalculate to compensate for encoder errors
-                         // if didn't stop for proximity to set point, avoid going to
-                         // infinity keeps dancing around the setpoint...
+            if (independent) {
+                supervise_independent();
+            } else if (!planner.has_next()) {
+                // Last segment, finished in closed loop
+                if (encoder_seq != segment_seq) {
+                    program_encoders();
+                }
 
-            if (!was_soft_stopped) {
-                current_freq = kp.run(leader_axis->destination_counts, leader_axis->current_counts);
-            } else {
-                current_freq = kp.run_unattenuated(leader_axis->destination_counts, leader_axis->current_counts);
+                if (!arcgen.active) {
+                    calculate(); // recalculate to compensate for encoder errors
+                                 // if didn't stop for proximity to set point, avoid going to
+                                 // infinity keeps dancing around the setpoint...
+                }
+            } else if (direction_seq != segment_seq) {
+                write_directions();
             }
-            lDebug(Debug, "Control output = %i: ", current_freq);
-            tmr.change_freq(current_freq);
         }
     }
 }
 
+/**
+ * @brief   checks whether the path has been finished, before a tick
+ * @returns false if all the axes are already there, and the stepping must
+ *          stop
+ */
+template <typename... Axes> bool bresenham<Axes...>::begin_tick(BaseType_t *higher_priority_task_woken) {
+    already_there = is_final_segment() &&
+                    std::all_of(axes.begin(), axes.end(), [](mot_pap *axis) { return axis->check_already_there(); });
+    if (already_there || is_jog_finished()) {
+        xSemaphoreGiveFromISR(supervisor_semaphore, higher_priority_task_woken);
+        return false;
+    }
+    return true;
+}
+
+/**
+ * @brief   accounts for a stepped tick: starts the next segment when the
+ *          current one is done, and wakes the supervisor up
+ */
+template <typename... Axes> void bresenham<Axes...>::end_tick(BaseType_t *higher_priority_task_woken) {
+    TickType_t ticks_now = xTaskGetTickCount();
+
+    if (ticks_left) {
+        ticks_left--;
+    }
+
+    if (independent && ++stepgen_ticks >= STEPGEN_UPDATE_TICKS) {
+        stepgen_ticks = 0;
+        update_stepgens(higher_priority_task_woken);
+    }
+
+    if (!ticks_left && planner.has_next()) {
+        next_segment();
+        ticks_last_time = ticks_now;
+        xSemaphoreGiveFromISR(supervisor_semaphore, higher_priority_task_woken);
+    } else if (!ticks_left && arcgen.active) {
+        arcgen.active = false; // the end of the path, the supervisor finishes it in closed loop
+        ticks_last_time = ticks_now;
+        xSemaphoreGiveFromISR(supervisor_semaphore, higher_priority_task_woken);
+    } else if ((ticks_now - ticks_last_time) > pdMS_TO_TICKS(step_time.count())) {
+        ticks_last_time = ticks_now;
+        xSemaphoreGiveFromISR(supervisor_semaphore, higher_priority_task_woken);
+    }
+}
+
 /**
  * @brief   function called by the timer ISR to generate the output pulses
  */
-void bresenham::isr() {
+template <typename... Axes> void bresenham<Axes...>::isr() {
+    cycle_scope cycles(step_isr_cycles);
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    TickType_t ticks_now = xTaskGetTickCount();
 
-    already_there = first_axis->check_already_there() && second_axis->check_already_there();
-    if (already_there) {
+    if (hard_stop_requested) {
+        return; // a match that was already pending
+    }
+
+    if (begin_tick(&xHigherPriorityTaskWoken)) {
+        step();
+        end_tick(&xHigherPriorityTaskWoken);
+        run_profile();
+    } else {
         stop();
-        xSemaphoreGiveFromISR(supervisor_semaphore, &xHigherPriorityTaskWoken);
-        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
-        goto cont;
     }
 
-    step();
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
 
-    if ((ticks_now - ticks_last_time) > pdMS_TO_TICKS(step_time.count())) {
-        ticks_last_time = ticks_now;
-        xSemaphoreGiveFromISR(supervisor_semaphore, &xHigherPriorityTaskWoken);
-        portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+/**
+ * @brief   function called by the DMA ISR when it has output one half of the
+ *          step schedule, refills it with the ticks that follow the other one
+ */
+template <typename... Axes> void bresenham<Axes...>::dma_isr() {
+    cycle_scope cycles(step_isr_cycles);
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    enum step_dma::half half = dma.completed_half();
+
+    if (hard_stop_requested || half == step_dma::NONE) {
+        return;
+    }
+
+    if (half == schedule_end_half) {
+        stop(); // the end of the path has been output
+    } else {
+        fill_schedule(half, &xHigherPriorityTaskWoken);
     }
 
-cont:;
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
 
 /**
  * @brief   if there is a movement in process, stops it
  * @returns nothing
  */
-void bresenham::stop() {
+template <typename... Axes> void bresenham<Axes...>::stop() {
     is_moving = false;
     tmr.stop();
-    current_freq = 0;
+    dma.stop();
     if (has_brakes) {
         rema::brakes_apply();
     }
 }
 
+/**
+ * @brief   stops the stepping right away, without waiting for the queued
+ *          commands nor for a move() in progress, e.g. releasing the brakes.
+ *          The axis task finishes the stop afterwards
+ * @note    to be called from a task. See hard_stop_from_isr()
+ */
+template <typename... Axes> void bresenham<Axes...>::hard_stop() {
+    request_hard_stop();
+    xTaskNotifyGive(task_handle);
+}
+
+/**
+ * @brief   same as hard_stop(), for interrupt handlers
+ */
+template <typename... Axes> void bresenham<Axes...>::hard_stop_from_isr(BaseType_t *higher_priority_task_woken) {
+    request_hard_stop();
+    vTaskNotifyGiveFromISR(task_handle, higher_priority_task_woken);
+}
+
+template <typename... Axes> void bresenham<Axes...>::request_hard_stop() {
+    hard_stop_sent = commands_sent;
+    hard_stop_requested = true;
+    tmr.stop();
+    dma.stop();
+    is_moving = false;
+}
+
+/**
+ * @brief   finishes a hard stop from the axis task: drops the commands that
+ *          were queued before it and the planned path, and applies the brakes
+ * @note    the commands sent after the hard stop stay queued, to be applied
+ */
+template <typename... Axes> void bresenham<Axes...>::finish_hard_stop() {
+    bresenham_msg<N> dropped;
+    while (static_cast<int32_t>(hard_stop_sent - commands_done) > 0 && commands.pop(dropped)) {
+        commands_done++;
+    }
+
+    stop();
+    planner.clear();
+    hard_stop_requested = false;
+    lDebug(Info, "Hard stop %s", name);
+}
+
 /**
  * @brief   if there is a movement in process, stops it
  * @returns nothing
  */
-void bresenham::pause() {
+template <typename... Axes> void bresenham<Axes...>::pause() {
     if (is_moving) {
         tmr.stop();
     }
@@ -283,15 +1380,92 @@ void bresenham::pause() {
  * @brief   if there was a movement in process, resume it
  * @returns nothing
  */
-void bresenham::resume() {
+template <typename... Axes> void bresenham<Axes...>::resume() {
     if (is_moving) {
         tmr.start();
     }
 }
 
-void bresenham::send(bresenham_msg msg) {
-    auto *msg_ptr = new bresenham_msg(msg);
-    if (xQueueSend(queue, &msg_ptr, portMAX_DELAY) == pdPASS) {
-        lDebug(Info, "%s: command sent", name);
+/**
+ * @brief   queues a command for the axis task, without allocating it
+ * @note    single producer, only one task may send commands
+ */
+template <typename... Axes> void bresenham<Axes...>::send(bresenham_msg<N> msg) {
+    switch (msg.type) {
+    case mot_pap::type::MOVE:
+    case mot_pap::type::MOVE_JOYSTICK:
+    case mot_pap::type::MOVE_INDEPENDENT:
+    case mot_pap::type::ARC:
+        commanded = msg.setpoints;
+        commanded_known = true;
+        break;
+    default:
+        commanded_known = false; // where the axes stop is up to the axis task
+        break;
+    }
+
+    commands_sent++; // before it can be popped, so commands_done never gets ahead
+    while (!commands.push(msg)) {
+        vTaskDelay(pdMS_TO_TICKS(1)); // full, the axis task is draining it
+    }
+    xTaskNotifyGive(task_handle);
+    lDebug(Info, "%s: command sent", name);
+}
+
+/**
+ * @brief   looks an axis up by its name
+ * @returns the index of the axis, or -1 if this interpolator doesn't drive it
+ */
+template <typename... Axes> int bresenham<Axes...>::axis_index(char name) const {
+    for (std::size_t i = 0; i < N; i++) {
+        if (axes[i]->name == name) {
+            return i;
+        }
     }
-}
\ No newline at end of file
+    return -1;
+}
+
+/**
+ * @brief   setpoint that keeps an axis where it is going: the one of the last
+ *          command sent while the axis task hasn't applied it yet, the end of
+ *          the queued path while moving, or its own setpoint in the
+ *          independent mode, its current position otherwise
+ * @note    for the task that sends the commands
+ */
+template <typename... Axes> int bresenham<Axes...>::hold_setpoint(std::size_t index) const {
+    if (commands_done != commands_sent && commanded_known) {
+        return commanded[index];
+    }
+    // Read at once, against the step ISR finishing the path and
+    // queue_segment(), which pushes under the same lock
+    taskENTER_CRITICAL();
+    int setpoint = !is_moving    ? axes[index]->current_counts
+                   : independent ? axes[index]->destination_counts
+                                 : planner.back().target[index];
+    taskEXIT_CRITICAL();
+    return setpoint;
+}
+
+/**
+ * @brief   velocity that keeps an axis jogging as it is, in counts/s, 0 if it
+ *          isn't being jogged
+ * @note    for the axis task, the commands pending may change it
+ */
+template <typename... Axes> int bresenham<Axes...>::hold_velocity(std::size_t index) const {
+    stepgen const &gen = stepgens[index];
+    if (!is_moving || !independent || !gen.jogging) {
+        return 0;
+    }
+    return lroundf(gen.jog_velocity / (2 * axes[index]->steps_per_count()));
+}
+
+/**
+ * @brief   true when the segment being stepped is the last one of the path
+ *          and the encoders were given its targets, so their already there
+ *          flags refer to it
+ */
+template <typename... Axes> bool bresenham<Axes...>::is_final_segment() const {
+    return encoder_seq == segment_seq && !planner.has_next();
+}
+
+template class bresenham<x_axis_traits, y_axis_traits, z_axis_traits>;
\ No newline at end of file
@@ -0,0 +1,207 @@
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iterator>
+
+#include "command_protocol.h"
+#include "cycles.h"
+#include "debug.h"
+#include "perfect_hash.h"
+
+// The names are looked up by cmds_hash, built from them at compile time
+static constexpr perfect_hash<std::size(command_protocol::cmds_names)> cmds_hash(command_protocol::cmds_names);
+static_assert(cmds_hash.found(), "no seed gives every command a slot of its own, raise MAX_SEEDS");
+
+/**
+ * @brief 	searchs for a matching command name in cmds_names[], with the
+ * perfect hash of the names built at compile time
+ * @returns the index of the command, its opcode, or -1 if there is none
+ */
+int command_protocol::cmd_index(char const *cmd) {
+    if (!cmd) {
+        return -1;
+    }
+    int i = cmds_hash.find(cmd);
+    return (i >= 0 && !strcmp(cmd, cmds_names[i])) ? i : -1;
+}
+
+/**
+ * @brief 	executes the command of cmds_names[] with a matching name,
+ * passing the parameters as a JSON object for the called function to parse
+ * them.
+ * @param 	*cmd 	:name of the command to execute
+ * @param   *pars   :JSON object containing the passed parameters to the called
+ * function
+ */
+json::MyJsonDocument command_protocol::cmd_execute(char const *cmd, json::JsonObject const pars) {
+    return cmd_execute(static_cast<std::size_t>(cmd_index(cmd)), pars); // -1 wraps around to an unknown one
+}
+
+/**
+ * @brief Defines a simple wire protocol base on JavaScript Object Notation
+ (JSON)
+ * @details Receives an JSON array of commands, serialized in one line and
+ * ended with a newline or a null character. Several of them may be sent
+ * without waiting for the answers, they are answered in order. Every answer
+ * ends with a null character.
+ * Every command entry in this array must be a JSON object,
+ containing
+ * a "command" string specifying the name of the called command, and a nested
+ JSON object
+ * with the parameters for the called command under the "pars" key.
+ * The called function must extract the parameters from the passed JSON object.
+ *
+ * Example of the received JSON object, shown on several lines:
+ *
+ * [
+      {"cmd": "MOVE_JOYSTICK",
+       "pars": {
+          "first_axis_setpoint": 500,
+          "second_axis_setpoint": 100
+       }
+      },
+      {"cmd": "LOGS",
+       "pars": {
+          "quantity": 10
+       }
+      }
+   ]
+
+ * Every executed command has the chance of returning a JSON object that will be
+ inserted
+ * in the response JSON object under a key corresponding to the executed command
+ name, or
+ * NULL if no answer is expected.
+ * An answer that doesn't fit is replaced by {"error": "Answer too long"}, or
+ * "Out Of Memory".
+ */
+
+/**
+ * @brief   writes an error as the answer, without the arena, which may be
+ *          exhausted
+ * @returns the length of the answer, with its null character, cut to fit
+ *          in tx_buff
+ */
+static int json_error(char const *error, char *tx_buff, std::size_t tx_size) {
+    int len = snprintf(tx_buff, tx_size, "{\"error\":\"%s\"}", error) + 1;
+    return std::min(static_cast<std::size_t>(len), tx_size); // cut to fit
+}
+
+/**
+ * @brief 	Parses the received JSON object looking for commands to execute
+ * and appends the outputs of the called commands to the response buffer.
+ * @param 	*rx_buff 	:pointer to the received buffer from the network
+ * @param   *tx_buff	:buffer for the answer
+ * @param   tx_size     :bytes of tx_buff
+ * @returns	the length of the answer, with its null character, 0 if there is
+ * none
+ */
+int command_protocol::json_wp(char *rx_buff, char *tx_buff, std::size_t tx_size) {
+    cycle_scope cycles(json_wp_cycles);
+    auto rx_JSON_value = json::MyJsonDocument();
+    json::DeserializationError error = json::deserializeJson(rx_JSON_value, rx_buff);
+
+    auto tx_JSON_value = json::MyJsonDocument();
+    int buff_len = 0;
+
+    if (error) {
+        lDebug_uart_semihost(Error, "Error json parse. %s", error.c_str());
+    } else {
+        for (json::JsonVariant command : rx_JSON_value.as<json::JsonArray>()) {
+            char const *command_name = command["cmd"];
+            lDebug_uart_semihost(Info, "Command Found: %s", command_name);
+            auto pars = command["pars"];
+
+            auto ans = cmd_execute(command_name, pars);
+            tx_JSON_value[command_name] = ans;
+        }
+
+        buff_len = json::measureJson(tx_JSON_value); /* returns 0 on fail */
+        buff_len++;
+        if (arena.failed || tx_JSON_value.overflowed()) {
+            lDebug_uart_semihost(Error, "Out Of Memory");
+            buff_len = json_error("Out Of Memory", tx_buff, tx_size);
+        } else if (static_cast<std::size_t>(buff_len) > tx_size) {
+            lDebug_uart_semihost(Error, "Answer too long");
+            buff_len = json_error("Answer too long", tx_buff, tx_size);
+        } else {
+            json::serializeJson(tx_JSON_value, tx_buff, buff_len);
+            lDebug_uart_semihost(Info, "%s", tx_buff);
+        }
+    }
+    return buff_len;
+}
+
+/**
+ * @brief Defines a binary wire protocol, alongside the JSON one
+ * @details Every message is one command, a bin_header followed by the
+ * parameters of the command, a MessagePack map with the same keys as the
+ * "pars" of the JSON protocol. The opcode is the index of the command in
+ * cmds_names[], reported by PROTOCOL_VERSION with "opcodes": true. It may be
+ * sent on the same connection as the JSON batches, they are told apart by
+ * BIN_MAGIC.
+ * The answer has the same header, with the opcode and seq of the command,
+ * followed by the answer of the command in MessagePack, "UNKNOWN COMMAND"
+ * for an unknown opcode or the error if the parameters can't be parsed.
+ * An answer that doesn't fit is replaced by the error, as a string.
+ */
+
+/**
+ * @brief   writes an error as the answer, a MessagePack string after the
+ *          header of the command, cut to fit in tx_buff
+ * @param   error   :shorter than 32 characters, a fixstr
+ * @returns the length of the answer, 0 if not even the header fits
+ */
+static int bin_error(bin_header header, char const *error, char *tx_buff, std::size_t tx_size) {
+    if (tx_size < sizeof(header) + 1) {
+        return 0;
+    }
+    std::size_t error_len = std::min(strlen(error), tx_size - sizeof(header) - 1);
+    header.length = 1 + error_len;
+    memcpy(tx_buff, &header, sizeof(header));
+    tx_buff[sizeof(header)] = static_cast<char>(0xA0 | error_len);
+    memcpy(tx_buff + sizeof(header) + 1, error, error_len);
+    return sizeof(header) + header.length;
+}
+
+/**
+ * @brief 	executes the command of a binary message and serializes its
+ * answer.
+ * @param 	*rx_buff 	:the message, as framed by frame()
+ * @param   len         :bytes of the message
+ * @param   *tx_buff	:buffer for the answer
+ * @param   tx_size     :bytes of tx_buff
+ * @returns	the length of the answer, 0 if there is none
+ */
+int command_protocol::bin_wp(char const *rx_buff, std::size_t len, char *tx_buff, std::size_t tx_size) {
+    cycle_scope cycles(bin_wp_cycles);
+    bin_header header;
+    memcpy(&header, rx_buff, sizeof(header));
+
+    auto pars = json::MyJsonDocument();
+    json::MyJsonDocument ans;
+    json::DeserializationError error;
+    if (header.length) {
+        error = json::deserializeMsgPack(pars, rx_buff + sizeof(header), len - sizeof(header));
+    }
+    if (error) {
+        lDebug_uart_semihost(Error, "Error MessagePack parse. %s", error.c_str());
+        ans.set(error.c_str());
+    } else {
+        ans = cmd_execute(static_cast<std::size_t>(header.opcode), pars.as<json::JsonObject>());
+    }
+
+    std::size_t payload_len = json::measureMsgPack(ans);
+    if (arena.failed || ans.overflowed()) {
+        lDebug_uart_semihost(Error, "Out Of Memory");
+        return bin_error(header, "Out Of Memory", tx_buff, tx_size);
+    }
+    if (payload_len > UINT16_MAX || sizeof(header) + payload_len > tx_size) {
+        lDebug_uart_semihost(Error, "Answer too long");
+        return bin_error(header, "Answer too long", tx_buff, tx_size);
+    }
+    header.length = payload_len;
+    memcpy(tx_buff, &header, sizeof(header));
+    json::serializeMsgPack(ans, tx_buff + sizeof(header), payload_len);
+    return sizeof(header) + payload_len;
+}
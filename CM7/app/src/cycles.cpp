@@ -0,0 +1,44 @@
+#include "cycles.h"
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+/**
+ * @brief   adds a sample
+ */
+void cycle_stats::record(uint32_t cycles) {
+    count++;
+    total += cycles;
+    if (cycles < min) {
+        min = cycles;
+    }
+    if (cycles > max) {
+        max = cycles;
+    }
+
+    int bucket = 0;
+    if (cycles >= FIRST_BUCKET_CYCLES) {
+        // floor(log2(cycles / FIRST_BUCKET_CYCLES)) + 1
+        bucket = __builtin_clz(FIRST_BUCKET_CYCLES) - __builtin_clz(cycles) + 1;
+        if (bucket >= BUCKETS) {
+            bucket = BUCKETS - 1;
+        }
+    }
+    histogram[bucket]++;
+}
+
+/**
+ * @brief   consistent copy, not torn by an ISR recording meanwhile
+ */
+cycle_stats cycle_stats::snapshot() const {
+    taskENTER_CRITICAL();
+    cycle_stats copy = *this;
+    taskEXIT_CRITICAL();
+    return copy;
+}
+
+void cycle_stats::reset() {
+    taskENTER_CRITICAL();
+    *this = cycle_stats();
+    taskEXIT_CRITICAL();
+}
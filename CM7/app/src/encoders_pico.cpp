@@ -8,11 +8,16 @@
 #include "task.h"
 
 #include "../inc/debug.h"
+#include "cycles.h"
 #include "mot_pap.h"
 #include "quadrature_encoder_constants.h"
 #include "rema.h"
 #include "spi.h"
 
+static int32_t to_int32(uint8_t const *rx) {
+    return static_cast<int32_t>(rx[0] << 24 | rx[1] << 16 | rx[2] << 8 | rx[3] << 0);
+}
+
 /**
  * @brief 	writes 1 byte (address or data) to the chip
  * @param 	data	: address or data to write through SPI
@@ -29,11 +34,52 @@ int32_t encoders_pico::write_register(uint8_t address, int32_t data) const {
                           static_cast<uint8_t>((data >> 8) & 0xFF),
                           static_cast<uint8_t>((data >> 0) & 0xFF) };
         ret = spi_write(&tx, 4, cs);
+        if (address > quadrature_encoder_constants::COUNTERS && address <= quadrature_encoder_constants::COUNTERS + 3) {
+            counters_generation++; // snapshots read from now on have the new counter
+        }
         xSemaphoreGive(encoders_mutex);
     }
     return ret;
 }
 
+/**
+ * @brief 	writes the targets and directions of all the axes and the
+ * position threshold in a single transfer, instead of one per register
+ * @param 	setup	: the registers of the AXES_SETUP block
+ * @returns	0 on success
+ * @note	one write per register if the Pico has no blocks
+ */
+int32_t encoders_pico::write_axes_setup(struct axes_setup const &setup) const {
+#if !defined(QUADRATURE_ENCODER_BLOCKS)
+    int32_t ret = 0;
+    for (int i = 0; i < 3; i++) {
+        ret |= write_register(quadrature_encoder_constants::TARGETS + i + 1, setup.targets[i]);
+        ret |= write_register(quadrature_encoder_constants::DIRECTIONS + i + 1, setup.directions[i]);
+    }
+    ret |= write_register(quadrature_encoder_constants::POS_THRESHOLDS, setup.threshold);
+    return ret;
+#else
+    int32_t words[] = { setup.targets[0],    setup.targets[1],    setup.targets[2], setup.directions[0],
+                        setup.directions[1], setup.directions[2], setup.threshold };
+    uint8_t tx[sizeof(words)];
+    for (size_t i = 0; i < sizeof(words) / sizeof(words[0]); i++) {
+        tx[4 * i + 0] = static_cast<uint8_t>((words[i] >> 24) & 0xFF);
+        tx[4 * i + 1] = static_cast<uint8_t>((words[i] >> 16) & 0xFF);
+        tx[4 * i + 2] = static_cast<uint8_t>((words[i] >> 8) & 0xFF);
+        tx[4 * i + 3] = static_cast<uint8_t>((words[i] >> 0) & 0xFF);
+    }
+
+    int32_t ret = 0;
+    if (encoders_mutex != nullptr && xSemaphoreTake(encoders_mutex, portMAX_DELAY) == pdTRUE) {
+        uint8_t write_address = quadrature_encoder_constants::AXES_SETUP | quadrature_encoder_constants::WRITE_MASK;
+        ret = spi_write(&write_address, 1, cs);
+        ret = spi_write(tx, sizeof(tx), cs);
+        xSemaphoreGive(encoders_mutex);
+    }
+    return ret;
+#endif
+}
+
 /**
  * @brief 	reads value from one of the RASPBERRY PI PICO ENCODERS
  * @param 	address	: address to read through SPI
@@ -48,7 +94,7 @@ int32_t encoders_pico::read_register(uint8_t address) const {
         spi_read(rx, 4, cs);
         xSemaphoreGive(encoders_mutex);
     }
-    return static_cast<int32_t>(rx[0] << 24 | rx[1] << 16 | rx[2] << 8 | rx[3] << 0);
+    return to_int32(rx);
 }
 
 /**
@@ -99,9 +145,76 @@ struct limits encoders_pico::read_limits_and_ack() const {
     return { rx[0], rx[1] };
 }
 
+/**
+ * @brief 	reads the counters of all the axes, the limits and the targets
+ * flags in a single transfer, instead of one per register
+ * @returns	the snapshot of the encoders
+ * @note	without blocks, the counters are read in one transfer and the
+ * limits in another, right after it
+ */
+struct encoders_snapshot encoders_pico::read_snapshot() const {
+    struct encoders_snapshot snapshot = {};
+#if defined(QUADRATURE_ENCODER_BLOCKS)
+    uint8_t rx[4 * 4] = { 0x00 };
+    uint8_t const *counters = &rx[0];
+    uint8_t const *limits = &rx[12];
+    uint8_t address = quadrature_encoder_constants::SNAPSHOT;
+#else
+    uint8_t rx[4 * 4 + 4] = { 0x00 }; // X, Y, Z and W counters, as read_counters(), then LIMITS
+    uint8_t const *counters = &rx[0];
+    uint8_t const *limits = &rx[16];
+    uint8_t address = quadrature_encoder_constants::COUNTERS;
+#endif
+    if (encoders_mutex != nullptr && xSemaphoreTake(encoders_mutex, portMAX_DELAY) == pdTRUE) {
+        spi_write(&address, 1, cs);
+        spi_read(rx, 4 * 4, cs);
+#if !defined(QUADRATURE_ENCODER_BLOCKS)
+        address = quadrature_encoder_constants::LIMITS;
+        spi_write(&address, 1, cs);
+        spi_read(&rx[16], 4, cs);
+#endif
+        snapshot.generation = counters_generation;
+        xSemaphoreGive(encoders_mutex);
+    }
+
+    for (int i = 0; i < 3; i++) {
+        snapshot.counters[i] = to_int32(&counters[4 * i]);
+    }
+    snapshot.limits = { limits[0], limits[1] };
+    snapshot.timestamp = timestamp_counter();
+    return snapshot;
+}
+
+/**
+ * @brief   reads the snapshot of the encoders ENCODERS_PICO_POLL_RATE_HZ
+ *          times per second and publishes it, so that readers get the latest
+ *          counts without waiting for the bus, feeds the observers of the axes
+ *          with it and checks their following errors
+ */
+void encoders_pico::poll_task([[maybe_unused]] void *pars) {
+    static_assert(ENCODERS_PICO_POLL_RATE_HZ <= configTICK_RATE_HZ, "the poller is paced by the RTOS tick");
+
+    TickType_t last_wake = xTaskGetTickCount();
+    while (true) {
+        struct encoders_snapshot snapshot = encoders->read_snapshot();
+        encoders->published.write(snapshot);
+        if (x_y_z_axes) {
+            for (mot_pap *axis : x_y_z_axes->axes) {
+                axis->observe(snapshot);
+            }
+            if (snapshot.generation == encoders->counters_generation) { // no counter was set while it was read
+                x_y_z_axes->check_for_stall();
+            }
+        }
+        vTaskDelayUntil(&last_wake, configTICK_RATE_HZ / ENCODERS_PICO_POLL_RATE_HZ);
+    }
+}
+
+static volatile bool axes_paused = false; // by the IRQ handler, for the task to resume them
+
 void encoders_pico::task([[maybe_unused]] void *pars) {
     // NVIC_SetPriority(PIN_INT0_IRQn, ENCODERS_PICO_INTERRUPT_PRIORITY);
-    gpio_pinint encoders_irq_pin = {GPIOA, 3, EXTI0_IRQn};  //
+    [[maybe_unused]] gpio_pinint encoders_irq_pin = {GPIOA, 3, EXTI0_IRQn};  //
     //encoders_irq_pin.mode_edge().int_high().clear_pending().enable();
 
     encoders->set_thresholds(MOT_PAP_POS_THRESHOLD);
@@ -109,31 +222,31 @@ void encoders_pico::task([[maybe_unused]] void *pars) {
 
     while (true) {
         if (xSemaphoreTake(encoders_pico_semaphore, portMAX_DELAY) == pdPASS) {
+            cycle_scope cycles(encoders_cycles);
+            bool paused = axes_paused;
+            axes_paused = false;
             struct limits limits = encoders->read_limits_and_ack();
             if (limits.hard & ENABLED_INPUTS_MASK) {
                 rema::hard_limits_reached();
             }
 
-            x_y_axes->first_axis->already_there = limits.targets & (1 << 0);
-            x_y_axes->second_axis->already_there = limits.targets & (1 << 1);
-            
-            if (x_y_axes->first_axis->already_there && x_y_axes->second_axis->already_there) {
-                x_y_axes->already_there = true;
-                x_y_axes->stop();
-                lDebug(Info, "%s: already there", x_y_axes->name);
-            } else {
-                x_y_axes->resume(); // Motors were paused by ISR to be able to read
-                                    // encoders information
+            // Targets of the intermediate segments of a path are not given to
+            // the encoders, their flags are stale until the last one starts
+            bool all_there = x_y_z_axes->is_final_segment();
+            if (all_there) {
+                for (mot_pap *axis : x_y_z_axes->axes) {
+                    axis->already_there = limits.targets & (1 << (axis->name - 'X'));
+                    all_there &= axis->already_there;
+                }
             }
 
-            z_dummy_axes->first_axis->already_there = limits.targets & (1 << 2);
-            if (z_dummy_axes->first_axis->already_there) {
-                z_dummy_axes->already_there = true;
-                z_dummy_axes->stop();
-                lDebug(Info, "%s: already there", z_dummy_axes->name);
-            } else {
-                z_dummy_axes->resume(); // Motors were paused by ISR to be able to read
-                                        // encoders information
+            if (all_there) {
+                x_y_z_axes->already_there = true;
+                x_y_z_axes->stop();
+                lDebug(Info, "%s: already there", x_y_z_axes->name);
+            } else if (paused) {
+                x_y_z_axes->resume(); // Motors were paused by ISR to be able to read
+                                      // encoders information
             }
         }
     }
@@ -143,8 +256,12 @@ void encoders_pico::task([[maybe_unused]] void *pars) {
 extern "C" void GPIO0_IRQHandler(void) {
     // Chip_PININT_ClearIntStatus(LPC_GPIO_PIN_INT, PININTCH(0));
     BaseType_t xHigherPriorityTaskWoken = pdFALSE;
-    x_y_axes->pause();
-    z_dummy_axes->pause();
+    // Only the flags of the last segment are looked at, the axes passing
+    // through the target of an intermediate one aren't stopped
+    if (x_y_z_axes->is_final_segment()) {
+        x_y_z_axes->pause();
+        axes_paused = true;
+    }
     xSemaphoreGiveFromISR(encoders_pico_semaphore, &xHigherPriorityTaskWoken);
     portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
 }
@@ -1,5 +1,6 @@
 #include "mot_pap.h"
 
+#include <cmath>
 #include <cstdint>
 #include <cstdlib>
 
@@ -24,11 +25,8 @@ enum mot_pap::direction mot_pap::direction_calculate(int error) {
 
 void mot_pap::set_direction(enum direction direction) {
     dir = direction;
-    if (is_dummy) {
-        return;
-    }
     // gpios.direction.set(dir == direction::CW ? 0 : 1);
-    encoders->set_direction(name, dir == direction::CW ? 0 : 1);
+    encoders->set_direction(name, encoder_direction());
     // lDebug_uart_semihost(Info, "%c, %s", name, (dir == direction::CW ? "+" : "-"));
 }
 
@@ -38,53 +36,25 @@ void mot_pap::set_direction() {
 }
 
 bool mot_pap::check_for_stall() {
-    if (is_dummy) {
-        return false;
-    }
-
-    const int expected_counts = ((half_pulses_stall >> 1) * encoder_resolution / motor_resolution);
-    const int pos_diff = std::abs((int)(current_counts - last_pos));
-
-    if (pos_diff < expected_counts) {
-        stalled_counter++;
-        if (stalled_counter >= stall_max_count) {
-            stalled_counter = 0;
-            stalled = true;
-            lDebug(Warn, "%c: stalled", name);
-            return true;
-        }
-    } else {
-        stalled_counter = 0;
+    float error = following_error();
+    if (std::fabs(error) > following_error_window) {
+        stalled = true;
+        lDebug(Warn, "%c: stalled, following error %d counts", name, static_cast<int>(error));
+        return true;
     }
-
-    half_pulses_stall = 0;
-    last_pos = current_counts;
     return false;
 }
 
 void mot_pap::stall_reset() {
     stalled = false;
-    stalled_counter = 0;
 }
 
+/**
+ * @brief   updates the current position with the one estimated by the
+ *          observer, without any SPI transfer
+ */
 void mot_pap::read_pos_from_encoder() {
-    if (is_dummy) {
-        return;
-    }
-
-    int counts = encoders->read_counter(name);
-    current_counts = reversed_encoder ? -counts : counts;
-}
-
-bool mot_pap::check_already_there() {
-    if (is_dummy) {
-        return true;
-    }
-
-    // int error = destination_counts() - current_counts();
-    // already_there = (abs((int) error) < MOT_PAP_POS_THRESHOLD);
-    // already_there set by encoders_pico
-    return already_there;
+    current_counts = static_cast<int>(std::lround(estimated_counts()));
 }
 
 /**
@@ -109,18 +79,3 @@ void mot_pap::update_position_simulated() {
     }
 }
 #endif
-
-void mot_pap::step() {
-    if (is_dummy) {
-        return;
-    }
-
-    ++half_pulses;
-    ++half_pulses_stall;
-
-#ifdef SIMULATE_ENCODER
-    update_position_simulated();
-#else
-    gpios.step.toggle();
-#endif
-}
@@ -0,0 +1,119 @@
+#include "planner.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @brief   speed the current segment must be left at: the entry speed of
+ *          the next one, or the min speed if the path ends there
+ */
+template <std::size_t N> float planner<N>::exit_speed() const {
+    if (has_next()) {
+        return next().entry_speed;
+    }
+    return segments[head % SEGMENTS].min_speed;
+}
+
+/**
+ * @brief   adds a segment at the end of the path
+ * @returns false if the queue is full
+ * @note    call recalculate() afterwards to replan the entry speeds
+ */
+template <std::size_t N> bool planner<N>::push(segment<N> const &seg) {
+    if (is_full()) {
+        return false;
+    }
+
+    segment<N> &s = segments[tail % SEGMENTS];
+    s = seg;
+    s.max_entry_speed = is_empty() ? s.min_speed : junction_speed(back(), s);
+    s.entry_speed = s.max_entry_speed;
+    tail++; // publishes the segment to the step ISR
+    return true;
+}
+
+/**
+ * @brief   drops the finished segment, the next one becomes the current
+ * @note    called from the step ISR
+ */
+template <std::size_t N> void planner<N>::advance() {
+    if (has_next()) {
+        head++;
+    }
+}
+
+/**
+ * @brief   max speed at the junction of two segments, by the junction
+ *          deviation method: the speed at which a circle of radius r,
+ *          tangent to both segments and deviating junction_deviation from
+ *          the corner, is followed at the planner acceleration. Arcs are
+ *          left along their tangent at the end
+ */
+template <std::size_t N> float planner<N>::junction_speed(segment<N> const &prev, segment<N> const &next) const {
+    float cos_theta = 0;
+    for (std::size_t i = 0; i < N; i++) {
+        cos_theta -= prev.exit_unit[i] * next.unit[i];
+    }
+
+    float max_speed = std::min(prev.nominal_speed, next.nominal_speed);
+    if (cos_theta > 0.999999f) { // reversal
+        return next.min_speed;
+    }
+
+    if (cos_theta < -0.999999f) { // straight line
+        return max_speed;
+    }
+
+    float sin_theta_d2 = sqrtf(0.5f * (1.0f - cos_theta));
+    float speed = sqrtf(acceleration * junction_deviation * sin_theta_d2 / (1.0f - sin_theta_d2));
+    return std::clamp(speed, next.min_speed, std::max(max_speed, next.min_speed));
+}
+
+/**
+ * @brief   replans the entry speeds of the queued segments, without changing
+ *          them yet: the step ISR may be loading them. The current one is
+ *          already being stepped and keeps its own.
+ * @note    call publish() afterwards, see it
+ */
+template <std::size_t N> void planner<N>::recalculate() {
+    uint32_t first = head;
+    uint32_t last = tail;
+    planned_last = last;
+    if (last - first < 2) {
+        return;
+    }
+
+    // Backward pass, the path must be able to stop at its end
+    float exit_speed = segments[(last - 1) % SEGMENTS].min_speed;
+    for (uint32_t i = last - 1; i != first; i--) {
+        segment<N> const &s = segments[i % SEGMENTS];
+        planned[i % SEGMENTS] = std::min(s.max_entry_speed, sqrtf(exit_speed * exit_speed + 2 * acceleration * s.length));
+        exit_speed = planned[i % SEGMENTS];
+    }
+
+    // Forward pass, a segment can't be entered faster than the previous one
+    // can accelerate to
+    planned[first % SEGMENTS] = segments[first % SEGMENTS].entry_speed;
+    for (uint32_t i = first + 1; i != last; i++) {
+        segment<N> const &prev = segments[(i - 1) % SEGMENTS];
+        float prev_entry = planned[(i - 1) % SEGMENTS];
+        float reachable = sqrtf(prev_entry * prev_entry + 2 * acceleration * prev.length);
+        planned[i % SEGMENTS] = std::max(std::min(planned[i % SEGMENTS], reachable), segments[i % SEGMENTS].min_speed);
+    }
+}
+
+/**
+ * @brief   gives the queued segments the entry speeds of the last
+ *          recalculate(), from the one after the current segment on, the
+ *          head may have advanced meanwhile
+ * @note    to be called with the step ISR masked, together with the update of
+ *          the exit speed of the current segment, so that the ISR sees
+ *          either the old speeds or the new ones
+ */
+template <std::size_t N> void planner<N>::publish() {
+    for (uint32_t i = head + 1; static_cast<int32_t>(planned_last - i) > 0; i++) {
+        segments[i % SEGMENTS].entry_speed = planned[i % SEGMENTS];
+    }
+}
+
+template class planner<3>;
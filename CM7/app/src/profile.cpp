@@ -0,0 +1,254 @@
+#include "profile.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace {
+constexpr int32_t ACCEL_ONE = 1 << profile::ACCEL_FRAC_BITS;
+constexpr uint32_t MAX_PERIOD = 1 << 22; // 2^31 for 2 * period * dn, the division is done in 64 bits above 2^31
+} // namespace
+
+/**
+ * @brief   ramp index of a tick rate: ticks needed to reach it from rest at
+ *          the max acceleration, v^2 / (2 a)
+ */
+int64_t profile::ramp_of(float tick_rate) const {
+    double accel_rate = 2.0 * max_accel; // ticks come at twice the step frequency
+    return static_cast<int64_t>(static_cast<double>(tick_rate) * tick_rate / (2 * accel_rate) * (1 << RAMP_FRAC_BITS));
+}
+
+/**
+ * @brief   timer counts between two ticks at the given tick rate
+ */
+uint32_t profile::period_of(float tick_rate) const {
+    if (tick_rate * MAX_PERIOD <= clock_hz) {
+        return MAX_PERIOD; // and no division by 0
+    }
+    return std::clamp<uint32_t>(lroundf(clock_hz / tick_rate), 1, MAX_PERIOD);
+}
+
+/**
+ * @brief   starts a profile from rest at the given frequency
+ */
+void profile::start(float freq) {
+    freq = std::clamp(freq, min_freq, max_freq);
+    period = period_of(2 * freq);
+    period_rest = 0;
+    ramp = ramp_of(2 * freq);
+    accel = 0;
+    phase = ACCEL;
+}
+
+/**
+ * @brief   sets the acceleration and jerk limits for a new segment, in
+ *          leader steps
+ * @param   acceleration    : max acceleration, steps/s^2
+ * @param   jerk            : max jerk, steps/s^3. 0 for a trapezoidal profile
+ * @note    set_exit() must be called afterwards, the exit ramp index depends
+ *          on the acceleration
+ */
+void profile::set_limits(float acceleration, float jerk) {
+    max_accel = std::max(acceleration, 1.0f);
+    this->jerk = jerk;
+
+    min_period = period_of(2 * max_freq);
+    max_period = period_of(2 * min_freq);
+    max_tick_rate = 2 * max_freq;
+    max_ramp = ramp_of(2 * max_freq);
+    min_ramp = ramp_of(2 * min_freq);
+
+    if (jerk > 0) {
+        double accel_rate = 2.0 * max_accel;
+        double jerk_rate = 2.0 * jerk;
+        jerk_time = accel_rate / jerk_rate * (1 << 16);
+        corner_rate = accel_rate * accel_rate / (2 * jerk_rate);
+        jerk_step = jerk_rate / accel_rate / clock_hz * ACCEL_ONE * (uint64_t(1) << 32);
+    } else {
+        jerk_time = 0;
+        corner_rate = 0;
+        jerk_step = 0;
+    }
+
+    period = std::clamp(period, min_period, max_period);
+    period_rest = 0;
+    ramp = ramp_of(static_cast<float>(clock_hz) / period);
+    phase = ACCEL;
+}
+
+/**
+ * @brief   sets the frequency the segment must be left at
+ */
+void profile::set_exit(float exit_freq) {
+    this->exit_freq = std::clamp(exit_freq, min_freq, max_freq);
+    exit_tick_rate = 2 * this->exit_freq;
+    exit_period = period_of(exit_tick_rate);
+    exit_ramp = ramp_of(exit_tick_rate);
+}
+
+/**
+ * @brief   keeps the path speed when the leader axis changes, by scaling the
+ *          current frequency by the ratio between the frequencies of both
+ *          leaders. The acceleration is a fraction of the max one, which
+ *          scales by itself
+ * @note    set_limits() must be called afterwards, to recompute the ramp index
+ */
+void profile::rescale(float ratio) {
+    period = std::clamp<uint32_t>(lroundf(period / ratio), 1, MAX_PERIOD);
+    period_rest = 0;
+}
+
+/**
+ * @brief   advances the profile one timer tick
+ * @param   remaining_ticks : leader ticks to the end of the segment
+ * @returns the period of the next tick, timer counts
+ * @note    called from the step ISR, integer only
+ */
+uint32_t profile::run(uint32_t remaining_ticks) {
+    uint32_t tick_rate = clock_hz / period;
+
+    // Tick rate change while the current acceleration is ramped out, a^2 / (2 j)
+    int64_t corner = 0;
+    if (jerk_time) {
+        uint64_t accel_sq = static_cast<uint64_t>(static_cast<int64_t>(accel) * accel) >> ACCEL_FRAC_BITS;
+        corner = (accel_sq * corner_rate) >> ACCEL_FRAC_BITS;
+    }
+
+    // Braking distance, in ticks
+    int64_t braking = (ramp - exit_ramp) >> RAMP_FRAC_BITS;
+    if (jerk_time) {
+        uint64_t peak_rate = tick_rate;
+        if (accel > 0) {
+            // Still accelerating, the acceleration must be taken down first,
+            // which takes a / j while the speed still raises a^2 / (2 j)
+            uint64_t time = (static_cast<uint64_t>(accel) * jerk_time) >> ACCEL_FRAC_BITS;
+            peak_rate += corner;
+            braking += (peak_rate * time * (ACCEL_ONE + accel / 2)) >> (16 + ACCEL_FRAC_BITS);
+        }
+
+        // Ramping the max deceleration in and out takes (v + v_exit) / 2 * a / j
+        // more. An upper bound when the max deceleration is never reached
+        braking += ((peak_rate + exit_tick_rate) * jerk_time) >> 17;
+    }
+
+    bool is_above_exit = period < exit_period;
+    if (is_above_exit && (braking >= remaining_ticks || (phase == DECEL && 2 * braking >= remaining_ticks))) {
+        phase = DECEL; // with some hysteresis, not to chatter around the braking point
+    } else if (period > min_period) {
+        phase = ACCEL;
+    } else {
+        phase = CRUISE;
+    }
+
+    int32_t target = 0;
+    switch (phase) {
+    case ACCEL:
+        target = ACCEL_ONE;
+        if (jerk_time && static_cast<int64_t>(max_tick_rate) - tick_rate <= corner) {
+            target = 0; // round the corner into cruise
+        }
+        break;
+
+    case DECEL:
+        target = -ACCEL_ONE;
+        if (jerk_time && static_cast<int64_t>(tick_rate) - exit_tick_rate <= corner) {
+            target = 0; // round the corner into the exit frequency
+        }
+        break;
+
+    case CRUISE:
+    default:
+        break;
+    }
+
+    if (jerk_step) {
+        int32_t step = std::max<int32_t>((jerk_step * period) >> 32, 1);
+        accel = (accel < target) ? std::min(accel + step, target) : std::max(accel - step, target);
+    } else {
+        accel = target;
+    }
+
+    // AVR446 period update, the ramp index advances by the fraction of the
+    // max acceleration being applied. The remainder is carried to the next
+    // division, so the period doesn't drift
+    int32_t dn = accel >> (ACCEL_FRAC_BITS - RAMP_FRAC_BITS);
+    if (dn) {
+        int64_t den = 4 * ramp + 3 * dn;
+        if (den > 0) {
+            int64_t num = 2 * static_cast<int64_t>(period) * dn + period_rest;
+            int32_t delta;
+            if (den <= INT32_MAX && num >= INT32_MIN && num <= INT32_MAX) {
+                // The 32 bits division, much faster, for all but the slowest periods
+                delta = static_cast<int32_t>(num) / static_cast<int32_t>(den);
+                period_rest = static_cast<int32_t>(num) % static_cast<int32_t>(den);
+            } else {
+                delta = num / den;
+                period_rest = num % den;
+            }
+            period -= delta;
+        }
+        ramp += dn;
+    }
+
+    if (phase == DECEL && period >= exit_period) {
+        period = exit_period;
+        ramp = exit_ramp;
+        accel = 0;
+        period_rest = 0;
+    }
+
+    // The remainder is kept while the period leaves a limit by less than a
+    // timer count
+    if (period < min_period || (period == min_period && accel > 0)) {
+        period = min_period;
+        ramp = max_ramp;
+        accel = std::min(accel, 0);
+        period_rest = 0;
+    } else if (period > max_period || (period == max_period && accel < 0)) {
+        period = max_period;
+        ramp = min_ramp;
+        accel = std::max(accel, 0);
+        period_rest = 0;
+    }
+    return period;
+}
+
+/**
+ * @brief   current step frequency
+ */
+float profile::get_freq() const {
+    return period ? clock_hz / (2.0f * period) : 0;
+}
+
+/**
+ * @brief   distance, in leader steps, needed to slow down from the current
+ *          frequency to the exit one
+ * @note    not for the ISR, floating point
+ */
+float profile::braking_distance(float exit_freq) const {
+    float freq = get_freq();
+    float accel = this->accel * max_accel / ACCEL_ONE;
+    float extra = 0;
+    if (jerk > 0 && accel > 0) {
+        // Still accelerating, the acceleration must be taken down first
+        float time = accel / jerk;
+        freq += accel * time / 2;
+        extra = freq * time;
+    }
+
+    float dv = freq - exit_freq;
+    if (dv <= 0 || max_accel <= 0) {
+        return extra;
+    }
+
+    float time = dv / max_accel;
+    if (jerk > 0) {
+        float ramp_time = max_accel / jerk;
+        if (dv < max_accel * ramp_time) {
+            time = 2 * sqrtf(dv / jerk); // max deceleration is never reached
+        } else {
+            time += ramp_time;
+        }
+    }
+
+    return (freq + exit_freq) / 2 * time + extra;
+}
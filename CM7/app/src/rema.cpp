@@ -30,9 +30,9 @@ void rema::control_enabled_set(bool status) {
     control_enabled = status;
     shut_down_out.set(!status);
     if (status) {
-        x_y_axes->first_axis->stall_reset();
-        x_y_axes->second_axis->stall_reset();
-        z_dummy_axes->first_axis->stall_reset();
+        for (mot_pap *axis : x_y_z_axes->axes) {
+            axis->stall_reset();
+        }
     }
 }
 
@@ -76,8 +76,7 @@ bool rema::is_watchdog_expired() {
 void rema::hard_limits_reached() {
     /* TODO Read input pins to determine which limit has been reached and stop
      * only one motor*/
-    z_dummy_axes->stop();
-    x_y_axes->stop();
+    x_y_z_axes->hard_stop();
 }
 
 // IRQ Handler for Touch Probe
@@ -87,7 +86,7 @@ extern "C" void GPIO1_IRQHandler(void) {
 
     static TickType_t ticks_last_release_time = 0;
     TickType_t ticks_now = xTaskGetTickCountFromISR();
-    bool debounce_time_exceeded = (ticks_now - ticks_last_release_time) > pdMS_TO_TICKS(rema::touch_probe_debounce_time_ms);
+    [[maybe_unused]] bool debounce_time_exceeded = (ticks_now - ticks_last_release_time) > pdMS_TO_TICKS(rema::touch_probe_debounce_time_ms);
 
     // if (Chip_PININT_GetFallStates(LPC_GPIO_PIN_INT)) {
     //     Chip_PININT_ClearFallStates(LPC_GPIO_PIN_INT, PININTCH(1));    
@@ -101,16 +100,11 @@ extern "C" void GPIO1_IRQHandler(void) {
     //     Chip_PININT_ClearRiseStates(LPC_GPIO_PIN_INT, PININTCH(1));
   
     //     if (debounce_time_exceeded) {
-    //         if (x_y_axes->is_moving) {
-    //             x_y_axes->was_stopped_by_probe = true;
+    //         if (x_y_z_axes->is_moving) {
+    //             x_y_z_axes->was_stopped_by_probe = true;
     //         }
 
-    //         if (z_dummy_axes->is_moving) {
-    //             z_dummy_axes->was_stopped_by_probe = true;
-    //         }
-
-    //         x_y_axes->stop();
-    //         z_dummy_axes->stop();
+    //         x_y_z_axes->stop();
     //     }
     // }
 }
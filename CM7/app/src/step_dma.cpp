@@ -0,0 +1,61 @@
+#include "step_dma.h"
+
+/**
+ * @brief   starts moving the schedule to the step port and the timer, on
+ *          every update event, from its first entry
+ * @param   port    : the GPIO port of the step pins
+ * @param   bsrr    : BSRR words, count of them
+ * @param   periods : timer periods, count of them
+ * @param   count   : entries of the whole schedule, both halves
+ * @note    the timer must be started afterwards. With the DMA requests
+ *          enabled, its update interrupt is not
+ */
+void step_dma::start(GPIO_TypeDef *port, uint32_t const *bsrr, uint32_t const *periods, uint32_t count) {
+    this->port = port;
+    this->bsrr = bsrr;
+    this->periods = periods;
+    this->count = count;
+    next = 0;
+    flags = 0;
+
+    // bsrr_stream->PAR = reinterpret_cast<uint32_t>(&port->BSRR);
+    // bsrr_stream->M0AR = reinterpret_cast<uint32_t>(bsrr);
+    // bsrr_stream->NDTR = count;
+    // bsrr_stream->CR = DMA_SxCR_CIRC | DMA_SxCR_MINC | DMA_SxCR_PSIZE_1 | DMA_SxCR_MSIZE_1 | DMA_SxCR_DIR_0 | DMA_SxCR_HTIE | DMA_SxCR_TCIE | DMA_SxCR_EN;
+    // period_stream->PAR = reinterpret_cast<uint32_t>(&tim->ARR);
+    // period_stream->M0AR = reinterpret_cast<uint32_t>(periods);
+    // period_stream->NDTR = count;
+    // period_stream->CR = DMA_SxCR_CIRC | DMA_SxCR_MINC | DMA_SxCR_PSIZE_1 | DMA_SxCR_MSIZE_1 | DMA_SxCR_DIR_0 | DMA_SxCR_EN;
+    // tim->CCR1 = 0;
+    // tim->DIER = TIM_DIER_UDE | TIM_DIER_CC1DE;
+    started = true;
+}
+
+/**
+ * @brief   stops the streams, the entries left are not output
+ */
+void step_dma::stop() {
+    // tim->DIER = TIM_DIER_UIE;
+    // bsrr_stream->CR &= ~DMA_SxCR_EN;
+    // period_stream->CR &= ~DMA_SxCR_EN;
+    started = false;
+}
+
+/**
+ * @brief   the half of the schedule the streams are done with, and clears
+ *          the interrupt flags
+ * @returns step_dma::NONE if there is none
+ * @note    to be called from the stream interrupt handler
+ */
+enum step_dma::half step_dma::completed_half() {
+    uint32_t pending = flags; // DMA1->LISR
+    flags = 0;                // DMA1->LIFCR = DMA_LIFCR_CHTIF0 | DMA_LIFCR_CTCIF0;
+
+    if (pending & TRANSFER_COMPLETE) {
+        return SECOND;
+    }
+    if (pending & HALF_TRANSFER) {
+        return FIRST;
+    }
+    return NONE;
+}
@@ -0,0 +1,63 @@
+#include "stepgen.h"
+
+#include <algorithm>
+#include <cmath>
+
+/**
+ * @brief   advances the profile to the next update
+ * @param   position    : half pulses output so far
+ * @param   sign        : 1 if the axis is stepping towards increasing counts,
+ *                        -1 otherwise
+ * @param   dt          : seconds to the next update
+ * @returns the speed until the next update
+ */
+float stepgen::update(int32_t position, int sign, float dt) {
+    if (jogging) {
+        return update_jog(sign, dt);
+    }
+
+    int32_t distance = (target - position) * sign; // ahead of the axis
+    bool was_stopped = (speed == 0);
+    is_reversing = false;
+
+    if (distance <= 0) {
+        speed = std::max(speed - acceleration * dt, 0.0f);
+        if (!distance || speed < min_speed) {
+            speed = 0;
+            is_reversing = was_stopped && (distance < 0);
+        }
+        return speed;
+    }
+
+    if (stopping_distance() >= distance) {
+        speed = std::max(speed - acceleration * dt, min_speed);
+    } else {
+        speed = std::clamp(speed + acceleration * dt, min_speed, max_speed);
+    }
+
+    speed = std::min(speed, distance / dt);
+    return speed;
+}
+
+/**
+ * @brief   ramps the speed towards the jog velocity, stopping first if it is
+ *          the other way
+ */
+float stepgen::update_jog(int sign, float dt) {
+    float wanted = std::min(jog_velocity * sign, max_speed); // along the direction of the axis
+    bool was_stopped = (speed == 0);
+    is_reversing = false;
+
+    if (wanted <= 0) {
+        speed = std::max(speed - acceleration * dt, 0.0f);
+        if (speed < min_speed) {
+            speed = 0;
+            is_reversing = was_stopped && (wanted < 0);
+        }
+    } else if (speed < wanted) {
+        speed = std::min(std::max(speed + acceleration * dt, min_speed), wanted);
+    } else {
+        speed = std::max(speed - acceleration * dt, wanted);
+    }
+    return speed;
+}
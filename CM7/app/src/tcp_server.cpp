@@ -1,6 +1,8 @@
 #include "FreeRTOS.h"
 #include "task.h"
+#include <algorithm>
 #include <cstdint>
+#include <cstring>
 
 #include "bresenham.h"
 #include "../inc/debug.h"
@@ -10,102 +12,391 @@
 #include "rema.h"
 #include "tcp_server.h"
 //#include "temperature_ds18b20.h"
-#include "xy_axes.h"
-#include "z_axis.h"
+#include "xyz_axes.h"
 #include <lwip/netdb.h>
 
 #define KEEPALIVE_IDLE     (5)
 #define KEEPALIVE_INTERVAL (5)
 #define KEEPALIVE_COUNT    (3)
 
-static void stop_all() {
-    x_y_axes->stop();
-    z_dummy_axes->stop();
-    lDebug(Warn, "Stopping all");
+tcp_server *tcp_server::servers[TCP_SERVER_MAX_SERVERS] = {};
+tcp_connection tcp_server::connections[TCP_SERVER_SLOTS];
+
+/**
+ * @brief   queues data to be sent, after the output already pending
+ * @returns false if there is no room for it in the slot, nothing is queued
+ */
+bool tcp_connection::write(void const *data, std::size_t len) {
+    if (conn_state == state::FREE || tx_lent) {
+        return false;
+    }
+    if (tx_sent == tx_len) {
+        tx_sent = tx_len = 0;
+    }
+    if (len > sizeof(tx_buffer) - tx_len) {
+        return false;
+    }
+    memcpy(tx_buffer + tx_len, data, len);
+    tx_len += len;
+    conn_state = state::SENDING;
+    return true;
 }
 
+/**
+ * @brief   sends a buffer of the server instead of the one of the slot, for
+ *          output too large for it
+ * @returns false if there is output pending, nothing is queued
+ * @note    the buffer has to stay as it is while the connection is sending,
+ *          and nothing else can be queued until it is sent
+ */
+bool tcp_connection::write_lent(char const *data, std::size_t len) {
+    if (conn_state != state::READY) {
+        return false;
+    }
+    tx_lent = data;
+    tx_len = len;
+    tx_sent = 0;
+    conn_state = state::SENDING;
+    return true;
+}
+
+tcp_server::tcp_server(const char *name, int port, int max_connections, char *rx_buffers, std::size_t rx_size)
+    : name(name), port(port), max_connections(max_connections), rx_buffers(rx_buffers), rx_size(rx_size) {
+
+    bool first = !servers[0];
+    bool registered = false;
+    for (tcp_server *&server : servers) {
+        if (!server) {
+            server = this;
+            registered = true;
+            break;
+        }
+    }
+    if (!registered) {
+        lDebug_uart_semihost(Error, "%s: no room for more than %d servers", name, TCP_SERVER_MAX_SERVERS);
+        return;
+    }
 
-tcp_server::tcp_server(const char *name, int port) : name(name), port(port) {
+    if (first) {
+        xTaskCreate([](void *) { task(); }, "network_task", 1024, nullptr, TCP_SERVER_TASK_PRIORITY, NULL);
+    }
 
-    char task_name[configMAX_TASK_NAME_LEN];
-    memset(task_name, 0, sizeof(task_name));
-    strncat(task_name, name, sizeof(task_name) - strlen(task_name) - 1);
-    strncat(task_name, "_task", sizeof(task_name) - strlen(task_name) - 1);
-    xTaskCreate([](void *me) { static_cast<tcp_server *>(me)->task(); }, task_name, 1024, this, configMAX_PRIORITIES, NULL);
+    lDebug_uart_semihost(Info, "%s: created", name);
+}
 
-    lDebug_uart_semihost(Info, "%s: created", task_name);
+int tcp_server::connections_count() {
+    int count = 0;
+    for_each_connection([&](tcp_connection &) { count++; });
+    return count;
 }
 
-void tcp_server::task() {
-    char addr_str[128];
-    int ip_protocol = 0;
+/**
+ * @brief   opens the listening socket of a server
+ */
+void tcp_server::start_listening(tcp_server *server) {
+    struct sockaddr_in dest_addr;
+    memset(&dest_addr, 0, sizeof(dest_addr));
+    dest_addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    dest_addr.sin_family = AF_INET;
+    dest_addr.sin_port = htons(server->port);
+
+    int sock = lwip_socket(AF_INET, SOCK_STREAM, IPPROTO_IP);
+    if (sock < 0) {
+        lDebug_uart_semihost(Error, "Unable to create %s socket: errno %d", server->name, errno);
+        return;
+    }
+    int opt = 1;
+    lwip_setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+
+    if (lwip_bind(sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr)) != 0) {
+        lDebug_uart_semihost(Error, "%s socket unable to bind: errno %d", server->name, errno);
+        lwip_close(sock);
+        return;
+    }
+
+    if (lwip_listen(sock, server->max_connections) != 0) {
+        lDebug_uart_semihost(Error, "Error occurred during %s listen: errno %d", server->name, errno);
+        lwip_close(sock);
+        return;
+    }
+
+    lwip_fcntl(sock, F_SETFL, O_NONBLOCK);
+    server->listen_sock = sock;
+    lDebug_uart_semihost(Info, "%s socket listening, port %d", server->name, server->port);
+}
+
+/**
+ * @brief   takes a free slot for a client of a server, or turns it away if
+ *          the server is serving all the clients it can
+ */
+void tcp_server::accept_client(tcp_server *server) {
+    struct sockaddr source_addr;
+    socklen_t addr_len = sizeof(source_addr);
+    int sock = lwip_accept(server->listen_sock, &source_addr, &addr_len);
+    if (sock < 0) {
+        if (errno != EWOULDBLOCK) {
+            lDebug_uart_semihost(Error, "Unable to accept %s connection: errno %d", server->name, errno);
+        }
+        return;
+    }
+
+    tcp_connection *slot = nullptr;
+    if (server->connections_count() < server->max_connections) {
+        for (tcp_connection &conn : connections) {
+            if (conn.conn_state == tcp_connection::state::FREE) {
+                slot = &conn;
+                break;
+            }
+        }
+    }
+    if (!slot) {
+        lDebug_uart_semihost(Warn, "%s: no free connection slot, client turned away", server->name);
+        lwip_close(sock);
+        return;
+    }
+
     int keepAlive = 1;
     int keepIdle = KEEPALIVE_IDLE;
     int keepInterval = KEEPALIVE_INTERVAL;
     int keepCount = KEEPALIVE_COUNT;
-    struct sockaddr_in dest_addr;
+    lwip_setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepAlive, sizeof(int));
+    lwip_setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &keepIdle, sizeof(int));
+    lwip_setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &keepInterval, sizeof(int));
+    lwip_setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &keepCount, sizeof(int));
+    lwip_fcntl(sock, F_SETFL, O_NONBLOCK);
 
-    struct sockaddr_in *dest_addr_ip4 = (struct sockaddr_in *)&dest_addr;
-    dest_addr_ip4->sin_addr.s_addr = htonl(INADDR_ANY);
-    dest_addr_ip4->sin_family = AF_INET;
-    dest_addr_ip4->sin_port = htons(port);
-    ip_protocol = IPPROTO_IP;
+    // The first index not taken by another client of the server, there is
+    // one as it serves fewer than max_connections
+    std::size_t index = 0;
+    bool taken = true;
+    while (taken) {
+        taken = false;
+        server->for_each_connection([&](tcp_connection &conn) {
+            if (conn.slot == index) {
+                taken = true;
+                index++;
+            }
+        });
+    }
+    slot->slot = index;
+    slot->rx_buffer = server->rx_buffers ? server->rx_buffers + index * server->rx_size : nullptr;
 
-    int listen_sock = lwip_socket(AF_INET, SOCK_STREAM, ip_protocol);
-    if (listen_sock < 0) {
-        lDebug_uart_semihost(Error, "Unable to create %s socket: errno %d", name, errno);
-        vTaskDelete(NULL);
+    slot->sock = sock;
+    slot->server = server;
+    slot->rx_len = 0;
+    slot->rx_discarding = false;
+    slot->tx_len = slot->tx_sent = 0;
+    slot->conn_state = tcp_connection::state::READY;
+    lDebug_uart_semihost(Info, "%s: client connected, %d of %d", server->name, server->connections_count(), server->max_connections);
+}
+
+/**
+ * @brief   reads the input of a connection into its reassembly buffer and
+ *          passes the whole messages to its server, closes the connection
+ *          if the client closed it
+ */
+void tcp_server::read_input(tcp_connection &conn) {
+    static char discarded[64]; // input of the servers that take none
+    char *buffer = conn.rx_buffer ? conn.rx_buffer + conn.rx_len : discarded;
+    std::size_t room = conn.rx_buffer ? conn.server->rx_size - 1 - conn.rx_len : sizeof(discarded);
+
+    int len = lwip_recv(conn.sock, buffer, room, 0);
+    if (len < 0) {
+        if (errno != EWOULDBLOCK) {
+            lDebug(Error, "Error occurred during receiving %s: errno %d", conn.server->name, errno);
+            close_connection(conn);
+        }
+        return;
+    }
+    if (len == 0) {
+        lDebug(Warn, "%s connection closed", conn.server->name);
+        close_connection(conn);
         return;
     }
-    int opt = 1;
-    lwip_setsockopt(listen_sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-    lDebug_uart_semihost(Info, "%s socket created", name);
 
-    int err = lwip_bind(listen_sock, (struct sockaddr *)&dest_addr, sizeof(dest_addr));
-    if (err != 0) {
-        lDebug_uart_semihost(Error, "%s socket unable to bind: errno %d", name, errno);
-        lDebug_uart_semihost(Error, "IPPROTO: %d", AF_INET);
-        goto CLEAN_UP;
+    if (conn.rx_buffer) {
+        conn.rx_len += len;
+        take_messages(conn);
     }
-    lDebug_uart_semihost(Info, "%s socket bound, port %d", name, port);
+}
 
-    err = lwip_listen(listen_sock, 1);
-    if (err != 0) {
-        lDebug_uart_semihost(Error, "Error occurred during %s listen: errno %d", name, errno);
-        goto CLEAN_UP;
+/**
+ * @brief   finds the end of the message at the start of the input, a
+ *          newline or a null character, and null-terminates it there,
+ *          without a "\r" before the newline
+ * @param   message_len : filled with the bytes of the message, without
+ *                        its delimiter
+ * @returns the bytes of the message and its delimiter, 0 if it isn't whole
+ *          yet, or FRAME_ERROR if the input can't be framed, and the
+ *          connection has to be closed
+ */
+std::size_t tcp_server::frame(char *data, std::size_t len, std::size_t &message_len) {
+    std::size_t end = 0;
+    while (end < len && data[end] != '\n' && data[end] != '\0') {
+        end++;
+    }
+    if (end == len) {
+        return 0; // not whole yet
     }
 
-    while (1) {
-        lDebug_uart_semihost(Info, "%s socket listening", name);
+    message_len = (end && data[end - 1] == '\r') ? end - 1 : end;
+    data[message_len] = '\0';
+    return end + 1;
+}
 
-        struct sockaddr source_addr;
-        socklen_t addr_len = sizeof(source_addr);
-        int sock = lwip_accept(listen_sock, (struct sockaddr *)&source_addr, &addr_len);
-        if (sock < 0) {
-            lDebug_uart_semihost(Error, "Unable to accept %s connection: errno %d", name, errno);
-            break;
+/**
+ * @brief   passes the whole messages of the reassembly buffer of a
+ *          connection to its server, for as long as they are answered
+ *          without output pending, and keeps the rest for later
+ */
+void tcp_server::take_messages(tcp_connection &conn) {
+    std::size_t start = 0;
+    while (conn.conn_state == tcp_connection::state::READY) {
+        char *begin = conn.rx_buffer + start;
+        std::size_t len = 0;
+        std::size_t used = conn.server->frame(begin, conn.rx_len - start, len);
+        if (used == FRAME_ERROR) {
+            lDebug(Error, "%s input can't be framed, closing", conn.server->name);
+            close_connection(conn);
+            return;
+        }
+        if (!used) {
+            break; // not whole yet
         }
+        start += used;
 
-        // Set tcp keepalive option
-        lwip_setsockopt(sock, SOL_SOCKET, SO_KEEPALIVE, &keepAlive, sizeof(int));
-        lwip_setsockopt(sock, IPPROTO_TCP, TCP_KEEPIDLE, &keepIdle, sizeof(int));
-        lwip_setsockopt(sock, IPPROTO_TCP, TCP_KEEPINTVL, &keepInterval, sizeof(int));
-        lwip_setsockopt(sock, IPPROTO_TCP, TCP_KEEPCNT, &keepCount, sizeof(int));
-        // Convert ip address to string
-        if (source_addr.sa_family == PF_INET) {
-            inet_ntoa_r(((struct sockaddr_in *)&source_addr)->sin_addr, addr_str, sizeof(addr_str) - 1);
+        if (conn.rx_discarding) { // the end of the one too long
+            conn.rx_discarding = false;
+            continue;
+        }
+        if (len) {
+            conn.server->receive(conn, begin, len);
         }
-        //lDebug_uart_semihost(Info, "%s socket accepted ip address: %s", name, addr_str);
+    }
 
-        reply_fn(sock);
-        stop_all();
+    if (conn.conn_state == tcp_connection::state::FREE) {
+        return;
+    }
+    conn.rx_len -= start;
+    memmove(conn.rx_buffer, conn.rx_buffer + start, conn.rx_len);
+    if (conn.conn_state == tcp_connection::state::READY && conn.rx_len == conn.server->rx_size - 1) {
+        // Full without a whole message, or it would have been taken
+        lDebug(Error, "%s message longer than %u bytes, discarded", conn.server->name, static_cast<unsigned>(conn.server->rx_size - 1));
+        conn.rx_len = 0;
+        conn.rx_discarding = true;
+    }
+}
 
-        lwip_shutdown(sock, 0);
-        lwip_close(sock);
+/**
+ * @brief   sends as much of the pending output of a connection as the
+ *          socket takes without blocking
+ */
+void tcp_server::flush(tcp_connection &conn) {
+    char const *data = conn.tx_lent ? conn.tx_lent : conn.tx_buffer;
+    while (conn.tx_sent < conn.tx_len) {
+        // send() can return less bytes than supplied length.
+        int written = lwip_send(conn.sock, data + conn.tx_sent, conn.tx_len - conn.tx_sent, 0);
+        if (written < 0) {
+            if (errno != EWOULDBLOCK) {
+                lDebug(Error, "Error occurred during sending %s: errno %d", conn.server->name, errno);
+                close_connection(conn);
+            }
+            return;
+        }
+        conn.tx_sent += written;
     }
 
-CLEAN_UP:
-    lwip_close(listen_sock);
-    vTaskDelete(NULL);
+    conn.tx_lent = nullptr;
+    conn.tx_len = conn.tx_sent = 0;
+    conn.conn_state = tcp_connection::state::READY;
+    if (conn.rx_buffer) {
+        take_messages(conn); // pipelined after the one just answered
+    }
+}
+
+void tcp_server::close_connection(tcp_connection &conn) {
+    conn.server->closing(conn);
+    lwip_shutdown(conn.sock, SHUT_RDWR);
+    lwip_close(conn.sock);
+
+    conn.tx_lent = nullptr;
+    conn.tx_len = conn.tx_sent = 0;
+    conn.sock = -1;
+    conn.server = nullptr;
+    conn.rx_buffer = nullptr;
+    conn.rx_len = 0;
+    conn.conn_state = tcp_connection::state::FREE;
+}
+
+/**
+ * @brief   network task: waits for new clients, input and room to send on
+ *          the sockets of all the servers at once, and polls the servers in
+ *          between
+ * @note    a client leaving doesn't stop the axes, the watchdog restarted
+ *          by the telemetry does when no one is watching anymore
+ */
+void tcp_server::task() {
+    while (true) {
+        fd_set readset;
+        fd_set writeset;
+        FD_ZERO(&readset);
+        FD_ZERO(&writeset);
+        int maxfd = -1;
+        auto wait_on = [&](int sock, fd_set *set) {
+            FD_SET(sock, set);
+            maxfd = std::max(maxfd, sock);
+        };
+
+        for (tcp_server *server : servers) {
+            if (server && server->listen_sock < 0) {
+                start_listening(server);
+            }
+            if (server && server->listen_sock >= 0) {
+                wait_on(server->listen_sock, &readset);
+            }
+        }
+        for (tcp_connection &conn : connections) {
+            if (conn.conn_state == tcp_connection::state::READY) {
+                wait_on(conn.sock, &readset);
+            } else if (conn.conn_state == tcp_connection::state::SENDING) {
+                wait_on(conn.sock, &writeset); // no input is taken until the output was sent
+            }
+        }
+
+        if (maxfd < 0) { // not listening yet, the network may be down
+            vTaskDelay(pdMS_TO_TICKS(TCP_SERVER_POLL_MS));
+            continue;
+        }
+
+        struct timeval timeout = { 0, TCP_SERVER_POLL_MS * 1000 };
+        int ready = lwip_select(maxfd + 1, &readset, &writeset, nullptr, &timeout);
+        if (ready < 0) {
+            lDebug(Error, "Error occurred during select: errno %d", errno);
+            vTaskDelay(pdMS_TO_TICKS(TCP_SERVER_POLL_MS));
+            continue;
+        }
+
+        for (tcp_server *server : servers) {
+            if (server && server->listen_sock >= 0 && FD_ISSET(server->listen_sock, &readset)) {
+                accept_client(server);
+            }
+        }
+        for (tcp_connection &conn : connections) {
+            if (conn.conn_state == tcp_connection::state::READY && FD_ISSET(conn.sock, &readset)) {
+                read_input(conn);
+            }
+        }
+
+        for (tcp_server *server : servers) {
+            if (server) {
+                server->poll();
+            }
+        }
+
+        for (tcp_connection &conn : connections) {
+            if (conn.conn_state == tcp_connection::state::SENDING) {
+                flush(conn);
+            }
+        }
+    }
 }
@@ -1,11 +1,15 @@
 #include "FreeRTOS.h"
 #include "debug.h"
+#include <algorithm>
 #include <cctype>
+#include <cmath>
+#include <iterator>
 #include <memory>
 #include <stdio.h>
 #include <string.h>
 
 #include "bresenham.h"
+#include "cycles.h"
 #include "../inc/debug.h"
 #include "encoders_pico.h"
 #include "expected.hpp"
@@ -14,24 +18,55 @@
 #include "settings.h"
 #include "tcp_server_command.h"
 //#include "temperature_ds18b20.h"
-#include "xy_axes.h"
-#include "z_axis.h"
+#include "xyz_axes.h"
 #include "ip_fns.h"
 
-#define PROTOCOL_VERSION "JSON_1.0"
+#define PROTOCOL_VERSION     "JSON_1.0"
+#define BIN_PROTOCOL_VERSION "BIN_1.0"
 
 namespace json = ArduinoJson;
 
-bresenham *tcp_server_command::get_axes(const char *axis) {
+static const char *const setpoint_keys[] = { "first_axis_setpoint", "second_axis_setpoint", "third_axis_setpoint" };
+static const char *const delta_keys[] = { "first_axis_delta", "second_axis_delta", "third_axis_delta" };
+static const char *const velocity_keys[] = { "first_axis_velocity", "second_axis_velocity", "third_axis_velocity" };
+static const char *const center_keys[] = { "first_axis_center", "second_axis_center" };
 
-    switch (*axis) {
-    case 'z':
-    case 'Z': return z_dummy_axes; break;
-    default: return x_y_axes; break;
+#define ARC_RADIUS_TOLERANCE 4 // counts the end may be off the circle through the start
+
+/**
+ * @brief   walks the "axes" parameter ("XY", "Z", "XYZ"...) calling fn with
+ * the interpolator index of every named axis, and the position of its letter,
+ * which selects the first_axis_*, second_axis_* or third_axis_* parameters
+ * @param   *axes   :axes parameter, defaults to "XY" when missing
+ * @param   fn      :callable taking (int index, int n)
+ */
+template <typename F> static void for_each_axis(char const *axes, F fn) {
+    if (!axes) {
+        axes = "XY";
+    }
+
+    for (int n = 0; axes[n] && n < static_cast<int>(std::size(setpoint_keys)); n++) {
+        int index = x_y_z_axes->axis_index(toupper(axes[n]));
+        if (index >= 0) {
+            fn(index, n);
+        }
     }
 }
 
-tl::expected<void, const char *> check_control_and_brakes(bresenham *axes) {
+/**
+ * @brief   MOVE message that keeps every axis where it is going, for the
+ * commands to override the setpoints of the axes they name
+ */
+static bresenham_msg<3> hold_msg(enum mot_pap::type type = mot_pap::type::MOVE) {
+    bresenham_msg<3> msg;
+    msg.type = type;
+    for (std::size_t i = 0; i < msg.setpoints.size(); i++) {
+        msg.setpoints[i] = x_y_z_axes->hold_setpoint(i);
+    }
+    return msg;
+}
+
+tl::expected<void, const char *> check_control_and_brakes(xyz_bresenham *axes) {
     if (!rema::control_enabled_get()) {
         return tl::make_unexpected("Control is disabled");
     }
@@ -112,9 +147,24 @@ json::MyJsonDocument tcp_server_command::logs_cmd(json::JsonObject const pars) {
     return res;
 }
 
+/**
+ * @brief   the JSON protocol version, and all the supported ones. With
+ *          "opcodes": true, the opcodes of the commands in the binary
+ *          protocol too
+ */
 json::MyJsonDocument tcp_server_command::protocol_version_cmd(json::JsonObject const pars) {
     json::MyJsonDocument res;
     res["version"] = PROTOCOL_VERSION;
+    auto versions = res["versions"].to<json::JsonArray>();
+    versions.add(PROTOCOL_VERSION);
+    versions.add(BIN_PROTOCOL_VERSION);
+
+    if (pars["opcodes"]) {
+        auto opcodes = res["opcodes"].to<json::JsonObject>();
+        for (std::size_t i = 0; i < cmds_count; i++) {
+            opcodes[cmds_table[i].cmd_name] = i;
+        }
+    }
     return res;
 }
 
@@ -185,22 +235,16 @@ json::MyJsonDocument tcp_server_command::stall_control_settings_cmd(json::JsonOb
         rema::stall_control = pars["enabled"];
     }
 
-    if (pars.containsKey("counts_X")) {
-        x_y_axes->first_axis->stall_max_count = pars["counts_X"];;
-    }
-
-    if (pars.containsKey("counts_Y")) {
-        x_y_axes->second_axis->stall_max_count = pars["counts_Y"];;
-    }
+    res["status"] = rema::stall_control;
+    for (mot_pap *axis : x_y_z_axes->axes) {
+        char key[] = "counts_?";
+        key[sizeof(key) - 2] = axis->name;
 
-    if (pars.containsKey("counts_Z")) {
-        z_dummy_axes->first_axis->stall_max_count= pars["counts_Z"];
+        if (pars.containsKey(key)) {
+            axis->following_error_window = pars[key];
+        }
+        res[key] = axis->following_error_window;
     }
-
-    res["status"] = rema::stall_control;
-    res["counts_X"] = x_y_axes->first_axis->stall_max_count;
-    res["counts_Y"] = x_y_axes->second_axis->stall_max_count;
-    res["counts_Z"] = z_dummy_axes->first_axis->stall_max_count;
     return res;
 }
 
@@ -210,12 +254,13 @@ json::MyJsonDocument tcp_server_command::touch_probe_settings_cmd(json::JsonObje
         rema::touch_probe_protection = pars["protection"];
     }
 
+    // X, Y and Z share one interpolator, so they share the touching count
     if (pars.containsKey("counts_XY")) {
-        x_y_axes->touching_max_count = pars["counts_XY"];
+        x_y_z_axes->touching_max_count = pars["counts_XY"];
     }
 
     if (pars.containsKey("counts_Z")) {
-        z_dummy_axes->touching_max_count = pars["counts_Z"];
+        x_y_z_axes->touching_max_count = pars["counts_Z"];
     }
 
     if (pars.containsKey("debounce_time_ms")) {
@@ -223,26 +268,21 @@ json::MyJsonDocument tcp_server_command::touch_probe_settings_cmd(json::JsonObje
     }
 
     res["protection"] = rema::touch_probe_protection;
-    res["counts_XY"] = x_y_axes->touching_max_count;
-    res["counts_Z"] = z_dummy_axes->touching_max_count;
+    res["counts_XY"] = x_y_z_axes->touching_max_count;
+    res["counts_Z"] = x_y_z_axes->touching_max_count;
     res["debounce_time_ms"] = rema::touch_probe_debounce_time_ms;
     return res;
 }
 
 json::MyJsonDocument tcp_server_command::set_coords_cmd(json::JsonObject const pars) {
-    if (pars.containsKey("position_X")) {
-        double pos_x = pars["position_X"];
-        x_y_axes->first_axis->set_position(pos_x);
-    }
-
-    if (pars.containsKey("position_Y")) {
-        double pos_y = pars["position_Y"];
-        x_y_axes->second_axis->set_position(pos_y);
-    }
+    for (mot_pap *axis : x_y_z_axes->axes) {
+        char key[] = "position_?";
+        key[sizeof(key) - 2] = axis->name;
 
-    if (pars.containsKey("position_Z")) {
-        double pos_z = pars["position_Z"];
-        z_dummy_axes->first_axis->set_position(pos_z);
+        if (pars.containsKey(key)) {
+            double pos = pars[key];
+            axis->set_position(pos);
+        }
     }
     json::MyJsonDocument res;
     res["ack"] = true;
@@ -251,37 +291,46 @@ json::MyJsonDocument tcp_server_command::set_coords_cmd(json::JsonObject const p
 
 json::MyJsonDocument tcp_server_command::axes_settings_cmd(json::JsonObject const pars) {
     json::MyJsonDocument res;
-    double prop_gain = pars["prop_gain"];
     int update = pars["update"];
     int min = pars["min"];
     int max = pars["max"];
 
     if (pars.containsKey("axes")) {
-        char const *axes = pars["axes"];
-        bresenham *axes_ = get_axes(axes);
+        if (min <= 0 || max < min) {
+            res["error"] = "min must be positive and not above max";
+            return res;
+        }
+        xyz_bresenham *axes_ = x_y_z_axes;
         axes_->step_time = std::chrono::milliseconds(update);
-        axes_->kp.set_output_limits(min, max);
-        axes_->kp.set_sample_period(axes_->step_time);
-        axes_->kp.set_tunings(prop_gain);
+        axes_->profile.min_freq = min;
+        axes_->profile.max_freq = max;
+        if (pars.containsKey("acceleration")) {
+            axes_->planner.acceleration = pars["acceleration"];
+        }
+        if (pars.containsKey("jerk")) {
+            axes_->planner.jerk = pars["jerk"];
+        }
+        if (pars.containsKey("junction_deviation")) {
+            axes_->planner.junction_deviation = pars["junction_deviation"];
+        }
         lDebug_uart_semihost(Debug, "%s settings set", axes_->name);
         res["ack"] = true;
     } else {
-        res["XY"]["min_freq"] = x_y_axes->kp.out_min;
-        res["XY"]["max_freq"] = x_y_axes->kp.out_max;
-        res["XY"]["update_time"] = x_y_axes->step_time.count();
-        res["XY"]["prop_gain"] = x_y_axes->kp.kp_;
-
-        res["Z"]["min_freq"] = z_dummy_axes->kp.out_min;
-        res["Z"]["max_freq"] = z_dummy_axes->kp.out_max;
-        res["Z"]["update_time"] = z_dummy_axes->step_time.count();
-        res["Z"]["prop_gain"] = z_dummy_axes->kp.kp_;
+        // X, Y and Z share one interpolator, reported under both keys
+        for (char const *key : { "XY", "Z" }) {
+            res[key]["min_freq"] = x_y_z_axes->profile.min_freq;
+            res[key]["max_freq"] = x_y_z_axes->profile.max_freq;
+            res[key]["update_time"] = x_y_z_axes->step_time.count();
+            res[key]["acceleration"] = x_y_z_axes->planner.acceleration;
+            res[key]["jerk"] = x_y_z_axes->planner.jerk;
+            res[key]["junction_deviation"] = x_y_z_axes->planner.junction_deviation;
+        }
     }
     return res;
 }
 
 json::MyJsonDocument tcp_server_command::axes_hard_stop_all_cmd(json::JsonObject const pars) {
-    x_y_axes->send({ mot_pap::HARD_STOP });
-    z_dummy_axes->send({ mot_pap::HARD_STOP });
+    x_y_z_axes->hard_stop(); // not queued behind the pending commands
 
     json::MyJsonDocument res;
     res["ack"] = true;
@@ -289,8 +338,7 @@ json::MyJsonDocument tcp_server_command::axes_hard_stop_all_cmd(json::JsonObject
 }
 
 json::MyJsonDocument tcp_server_command::axes_soft_stop_all_cmd(json::JsonObject const pars) {
-    x_y_axes->send({ mot_pap::SOFT_STOP });
-    z_dummy_axes->send({ mot_pap::SOFT_STOP });
+    x_y_z_axes->send({ mot_pap::SOFT_STOP });
     json::MyJsonDocument res;
     res["ack"] = true;
     return res;
@@ -361,67 +409,120 @@ json::MyJsonDocument tcp_server_command::temperature_info_cmd(json::JsonObject c
 
 json::MyJsonDocument tcp_server_command::move_closed_loop_cmd(json::JsonObject const pars) {
     char const *axes = pars["axes"];
-    bresenham *axes_ = get_axes(axes);
     json::MyJsonDocument res;
 
-    auto check_result = check_control_and_brakes(axes_);
+    auto check_result = check_control_and_brakes(x_y_z_axes);
     if (!check_result) {
         res["error"] = check_result.error();
         return res;
     }
 
-    double first_axis_setpoint = pars["first_axis_setpoint"];
-    double second_axis_setpoint = pars["second_axis_setpoint"];
+    bresenham_msg<3> msg = hold_msg();
+    for_each_axis(axes, [&](int index, int n) {
+        double setpoint = pars[setpoint_keys[n]];
+        msg.setpoints[index] = static_cast<int>(setpoint * x_y_z_axes->axes[index]->inches_to_counts_factor);
+    });
 
-    bresenham_msg msg;
-    msg.type = mot_pap::type::MOVE;
-    msg.first_axis_setpoint = static_cast<int>(first_axis_setpoint * axes_->first_axis->inches_to_counts_factor);
-    msg.second_axis_setpoint = static_cast<int>(second_axis_setpoint * axes_->second_axis->inches_to_counts_factor);
-
-    axes_->send(msg);
+    x_y_z_axes->send(msg);
 
     lDebug_uart_semihost(
         Info,
-        "MOVE_CLOSED_LOOP First Axis Setpoint= %f, Second Axis Setpoint= %f",
-        first_axis_setpoint,
-        second_axis_setpoint);
+        "MOVE_CLOSED_LOOP X Setpoint= %i, Y Setpoint= %i, Z Setpoint= %i",
+        msg.setpoints[0],
+        msg.setpoints[1],
+        msg.setpoints[2]);
 
     res["ack"] = true;
     return res;
 }
 
-json::MyJsonDocument tcp_server_command::move_joystick_cmd(json::JsonObject const pars) {
+/**
+ * @brief   sends the named axes to their setpoints, each one with its own
+ *          profile. The axes already moving this way are retargeted while
+ *          the rest keep going, see bresenham::move_independent()
+ */
+json::MyJsonDocument tcp_server_command::move_independent_cmd(json::JsonObject const pars) {
     char const *axes = pars["axes"];
-    bresenham *axes_ = get_axes(axes);
     json::MyJsonDocument res;
 
-    auto check_result = check_control_and_brakes(axes_);
+    auto check_result = check_control_and_brakes(x_y_z_axes);
     if (!check_result) {
         res["error"] = check_result.error();
         return res;
     }
 
-    int first_axis_setpoint, second_axis_setpoint;
-    if (pars.containsKey("first_axis_setpoint")) {
-        first_axis_setpoint = static_cast<int>(pars["first_axis_setpoint"]);
-    } else {
-        first_axis_setpoint = axes_->first_axis->current_counts;
+    bresenham_msg<3> msg = hold_msg(mot_pap::type::MOVE_INDEPENDENT);
+    for_each_axis(axes, [&](int index, int n) {
+        if (pars.containsKey(setpoint_keys[n])) {
+            double setpoint = pars[setpoint_keys[n]];
+            msg.setpoints[index] = static_cast<int>(setpoint * x_y_z_axes->axes[index]->inches_to_counts_factor);
+        }
+    });
+
+    x_y_z_axes->send(msg);
+    res["ack"] = true;
+    return res;
+}
+
+/**
+ * @brief   jogs the named axes at signed velocities, in inches/s. The axes
+ *          not named keep their velocities. Every command only changes the
+ *          velocities the axes ramp to, the stepping goes on; the axes are
+ *          jogged to a stop if the commands stop coming, see
+ *          bresenham::jog()
+ */
+json::MyJsonDocument tcp_server_command::jog_velocity_cmd(json::JsonObject const pars) {
+    char const *axes = pars["axes"];
+    json::MyJsonDocument res;
+
+    auto check_result = check_control_and_brakes(x_y_z_axes);
+    if (!check_result) {
+        res["error"] = check_result.error();
+        return res;
     }
 
-    if (pars.containsKey("second_axis_setpoint")) {
-        second_axis_setpoint = static_cast<int>(pars["second_axis_setpoint"]);
-    } else {
-        second_axis_setpoint = axes_->second_axis->current_counts;
+    // The axis task fills in the velocities of the axes not named, the
+    // commands still pending may change them
+    bresenham_msg<3> msg = {};
+    msg.type = mot_pap::type::JOG_VELOCITY;
+    msg.named = 0;
+    for_each_axis(axes, [&](int index, int n) {
+        if (pars.containsKey(velocity_keys[n])) {
+            double velocity = pars[velocity_keys[n]];
+            msg.setpoints[index] = static_cast<int>(velocity * x_y_z_axes->axes[index]->inches_to_counts_factor);
+            msg.named |= 1 << index;
+        }
+    });
+
+    x_y_z_axes->send(msg);
+    res["ack"] = true;
+    return res;
+}
+
+json::MyJsonDocument tcp_server_command::move_joystick_cmd(json::JsonObject const pars) {
+    char const *axes = pars["axes"];
+    json::MyJsonDocument res;
+
+    auto check_result = check_control_and_brakes(x_y_z_axes);
+    if (!check_result) {
+        res["error"] = check_result.error();
+        return res;
     }
 
-    bresenham_msg msg;
-    msg.type = mot_pap::type::MOVE;
-    msg.first_axis_setpoint = first_axis_setpoint;
-    msg.second_axis_setpoint = second_axis_setpoint;
-    axes_->send(msg);
-    // lDebug_uart_semihost(Info, "MOVE_JOYSTICK First Axis Setpoint= %i, Second Axis Setpoint=
-    // %i",
-    //        first_axis_setpoint, second_axis_setpoint);
+    bresenham_msg<3> msg = hold_msg(mot_pap::type::MOVE_JOYSTICK);
+    msg.named = 0;
+    for_each_axis(axes, [&](int index, int n) {
+        msg.named |= 1 << index;
+        if (pars.containsKey(setpoint_keys[n])) {
+            msg.setpoints[index] = static_cast<int>(pars[setpoint_keys[n]]);
+        } else {
+            msg.setpoints[index] = x_y_z_axes->axes[index]->current_counts;
+        }
+    });
+
+    x_y_z_axes->send(msg);
+    // lDebug_uart_semihost(Info, "MOVE_JOYSTICK X Setpoint= %i, Y Setpoint= %i, Z Setpoint= %i",
+    //        msg.setpoints[0], msg.setpoints[1], msg.setpoints[2]);
 
     res["ack"] = true;
     return res;
@@ -429,38 +530,106 @@ json::MyJsonDocument tcp_server_command::move_joystick_cmd(json::JsonObject cons
 
 json::MyJsonDocument tcp_server_command::move_incremental_cmd(json::JsonObject const pars) {
     char const *axes = pars["axes"];
-    bresenham *axes_ = get_axes(axes);
     json::MyJsonDocument res;
 
-    auto check_result = check_control_and_brakes(axes_);
+    auto check_result = check_control_and_brakes(x_y_z_axes);
     if (!check_result) {
         res["error"] = check_result.error();
         return res;
     }
 
-    double first_axis_delta, second_axis_delta;
-    if (pars.containsKey("first_axis_delta")) {
-        first_axis_delta = pars["first_axis_delta"];
-    } else {
-        first_axis_delta = 0;
+    bresenham_msg<3> msg = hold_msg();
+    for_each_axis(axes, [&](int index, int n) {
+        mot_pap *axis = x_y_z_axes->axes[index];
+        double delta = 0;
+        if (pars.containsKey(delta_keys[n])) {
+            delta = pars[delta_keys[n]];
+        }
+        msg.setpoints[index] += delta * axis->inches_to_counts_factor; // from the end of the queued path
+    });
+
+    x_y_z_axes->send(msg);
+    // lDebug_uart_semihost(Info, "MOVE_INCREMENTAL X Setpoint= %i, Y Setpoint= %i, Z Setpoint= %i",
+    //        msg.setpoints[0], msg.setpoints[1], msg.setpoints[2]);
+    res["ack"] = true;
+    return res;
+}
+
+/**
+ * @brief   moves the two named axes ("XY" by default) along a circle, from the end of the
+ *          queued path to the setpoints, around the center, "CW" or "CCW"
+ *          from the first axis towards the second one. The end has to be on
+ *          the circle through the start, see bresenham::move_arc()
+ */
+json::MyJsonDocument tcp_server_command::arc_cmd(json::JsonObject const pars) {
+    char const *axes = pars["axes"];
+    char const *direction = pars["direction"];
+    json::MyJsonDocument res;
+
+    auto check_result = check_control_and_brakes(x_y_z_axes);
+    if (!check_result) {
+        res["error"] = check_result.error();
+        return res;
     }
 
-    if (pars.containsKey("second_axis_delta")) {
-        second_axis_delta = pars["second_axis_delta"];
-    } else {
-        second_axis_delta = 0;
-    }
-
-    bresenham_msg msg;
-    msg.type = mot_pap::type::MOVE;
-    msg.first_axis_setpoint =
-        axes_->first_axis->current_counts + (first_axis_delta * axes_->first_axis->inches_to_counts_factor);
-    msg.second_axis_setpoint =
-        axes_->second_axis->current_counts + (second_axis_delta * axes_->first_axis->inches_to_counts_factor);
-    axes_->send(msg);
-    // lDebug_uart_semihost(Info, "MOVE_INCREMENTAL First Axis Setpoint= %i, Second Axis
-    // Setpoint= %i",
-    //        msg.first_axis_setpoint, msg.second_axis_setpoint);
+    bresenham_msg<3> msg = hold_msg(mot_pap::type::ARC);
+    int named = 0;
+    for_each_axis(axes, [&](int index, int n) {
+        if (n < static_cast<int>(std::size(center_keys))) {
+            mot_pap *axis = x_y_z_axes->axes[index];
+            double setpoint = pars[setpoint_keys[n]];
+            double center = pars[center_keys[n]];
+            msg.setpoints[index] = static_cast<int>(setpoint * axis->inches_to_counts_factor);
+            msg.arc.axes[n] = index;
+            msg.arc.center[n] = static_cast<int>(center * axis->inches_to_counts_factor);
+            named++;
+        }
+    });
+
+    if ((axes && strlen(axes) != 2) || named != 2 || msg.arc.axes[0] == msg.arc.axes[1]) {
+        res["error"] = "Two different axes are needed";
+        return res;
+    }
+
+    if (!direction || (strcmp(direction, "CW") && strcmp(direction, "CCW"))) {
+        res["error"] = "Direction must be CW or CCW";
+        return res;
+    }
+    msg.arc.clockwise = !strcmp(direction, "CW");
+
+    mot_pap const *first = x_y_z_axes->axes[msg.arc.axes[0]];
+    mot_pap const *second = x_y_z_axes->axes[msg.arc.axes[1]];
+    if (first->steps_per_count() != second->steps_per_count()) {
+        res["error"] = "The axes don't step the same per count";
+        return res;
+    }
+
+    auto radius = [&](auto position) {
+        return hypot(position(0) - msg.arc.center[0], position(1) - msg.arc.center[1]);
+    };
+    double start_radius = radius([&](int n) { return x_y_z_axes->hold_setpoint(msg.arc.axes[n]); });
+    double end_radius = radius([&](int n) { return msg.setpoints[msg.arc.axes[n]]; });
+    if (!lround(start_radius)) {
+        res["error"] = "The start is on the center";
+        return res;
+    }
+    if (fabs(end_radius - start_radius) > std::max<double>(ARC_RADIUS_TOLERANCE, start_radius / 1000)) {
+        res["error"] = "The end is not on the circle through the start";
+        return res;
+    }
+
+    x_y_z_axes->send(msg);
+
+    lDebug_uart_semihost(Info,
+                         "ARC %s, %c: %i, %c: %i, center %i, %i",
+                         direction,
+                         first->name,
+                         msg.setpoints[msg.arc.axes[0]],
+                         second->name,
+                         msg.setpoints[msg.arc.axes[1]],
+                         msg.arc.center[0],
+                         msg.arc.center[1]);
+
     res["ack"] = true;
     return res;
 }
@@ -470,16 +639,18 @@ json::MyJsonDocument tcp_server_command::read_encoders_cmd(json::JsonObject cons
 
     if (pars.containsKey("axis")) {
         char const *axis = pars["axis"];
-        res[axis] = encoders->read_counter(axis[0]);
+        if (axis[0] < 'X' || axis[0] > 'Z') {
+            res["error"] = "unknown axis";
+            return res;
+        }
+        res[axis] = encoders->latest().counter(axis[0]);
         return res;
     } else {
 
-        uint8_t rx[4 * 3] = { 0x00 };
-        encoders->read_counters(rx);
-        int32_t x = (rx[0] << 24 | rx[1] << 16 | rx[2] << 8 | rx[3] << 0);
-        int32_t y = (rx[4] << 24 | rx[5] << 16 | rx[6] << 8 | rx[7] << 0);
-        int32_t z = (rx[8] << 24 | rx[9] << 16 | rx[10] << 8 | rx[11] << 0);
-        int32_t w [[maybe_unused]] = (rx[12] << 24 | rx[13] << 16 | rx[14] << 8 | rx[15] << 0);
+        struct encoders_snapshot snapshot = encoders->latest();
+        int32_t x = snapshot.counter('X');
+        int32_t y = snapshot.counter('Y');
+        int32_t z = snapshot.counter('Z');
 
         res["X"] = x;
         res["Y"] = y;
@@ -494,184 +665,63 @@ json::MyJsonDocument tcp_server_command::read_limits_cmd(json::JsonObject const
     return res;
 }
 
-// @formatter:off
-const tcp_server_command::cmd_entry tcp_server_command::cmds_table[] = {
-    {
-        "PROTOCOL_VERSION",                        /* Command name */
-        &tcp_server_command::protocol_version_cmd, /* Associated function */
-    },
-    {
-        "CONTROL_ENABLE",
-        &tcp_server_command::control_enable_cmd,
-    },
-    {
-        "BRAKES_MODE",
-        &tcp_server_command::brakes_mode_cmd,
-    },
-    {
-        "TOUCH_PROBE",
-        &tcp_server_command::touch_probe_cmd,
-    },
-    {
-        "STALL_CONTROL_SETTINGS",
-        &tcp_server_command::stall_control_settings_cmd,
-    },
-    {
-        "TOUCH_PROBE_SETTINGS",
-        &tcp_server_command::touch_probe_settings_cmd,
-    },
-    {
-        "AXES_HARD_STOP_ALL",
-        &tcp_server_command::axes_hard_stop_all_cmd,
-    },
-    {
-        "AXES_SOFT_STOP_ALL",
-        &tcp_server_command::axes_soft_stop_all_cmd,
-    },
-    {
-        "LOGS",
-        &tcp_server_command::logs_cmd,
-    },
-    {
-        "LOG_LEVEL",
-        &tcp_server_command::log_level_cmd,
-    },
-
-    {
-        "AXES_SETTINGS",
-        &tcp_server_command::axes_settings_cmd,
-    },
-    {
-        "NETWORK_SETTINGS",
-        &tcp_server_command::network_settings_cmd,
-    },
-    {
-        "MEM_INFO",
-        &tcp_server_command::mem_info_cmd,
-    },
-    {
-        "TEMP_INFO",
-        &tcp_server_command::temperature_info_cmd,
-    },
-    {
-        "SET_COORDS",
-        &tcp_server_command::set_coords_cmd,
-    },
-    {
-        "MOVE_JOYSTICK",
-        &tcp_server_command::move_joystick_cmd,
-    },
-    {
-        "MOVE_CLOSED_LOOP",
-        &tcp_server_command::move_closed_loop_cmd,
-    },
-    {
-        "MOVE_INCREMENTAL",
-        &tcp_server_command::move_incremental_cmd,
-    },
-    {
-        "READ_ENCODERS",
-        &tcp_server_command::read_encoders_cmd,
-    },
-    {
-        "READ_LIMITS",
-        &tcp_server_command::read_limits_cmd,
-    },
-};
-// @formatter:on
-
 /**
- * @brief 	searchs for a matching command name in cmds_table[], passing the
- * parameters as a JSON object for the called function to parse them.
- * @param 	*cmd 	:name of the command to execute
- * @param   *pars   :JSON object containing the passed parameters to the called
- * function
+ * @brief   adds the cycle counts of a code section to a response, and resets
+ *          them if asked to
  */
-json::MyJsonDocument tcp_server_command::cmd_execute(char const *cmd, json::JsonObject const pars) {
-    for (unsigned int i = 0; i < (sizeof(cmds_table) / sizeof(cmds_table[0])); i++) {
-        if (!strcmp(cmd, cmds_table[i].cmd_name)) {
-            // return cmds_table[i].cmd_function(pars);
-            return (this->*(cmds_table[i].cmd_function))(pars);
-        }
+static void cycles_to_json(json::JsonObject obj, cycle_stats &stats, bool reset) {
+    cycle_stats s = stats.snapshot();
+    if (reset) {
+        stats.reset();
     }
-    lDebug_uart_semihost(Error, "No matching command found");
-    json::MyJsonDocument res;
-    res.set("UNKNOWN COMMAND");
-    return res;
-};
 
-/**
- * @brief Defines a simple wire protocol base on JavaScript Object Notation
- (JSON)
- * @details Receives an JSON array of commands
- * Every command entry in this array must be a JSON object,
- containing
- * a "command" string specifying the name of the called command, and a nested
- JSON object
- * with the parameters for the called command under the "pars" key.
- * The called function must extract the parameters from the passed JSON object.
- *
- * Example of the received JSON object:
- *
- * [
-      {"cmd": "MOVE_JOYSTICK",
-       "pars": {
-          "first_axis_setpoint": 500,
-          "second_axis_setpoint": 100
-       }
-      },
-      {"cmd": "LOGS",
-       "pars": {
-          "quantity": 10
-       }
-      }
-   ]
-
- * Every executed command has the chance of returning a JSON object that will be
- inserted
- * in the response JSON object under a key corresponding to the executed command
- name, or
- * NULL if no answer is expected.
- */
+    obj["count"] = s.count;
+    obj["min"] = s.count ? s.min : 0;
+    obj["max"] = s.max;
+    obj["mean"] = s.mean();
+    auto histogram = obj["histogram"].to<json::JsonArray>();
+    for (uint32_t samples : s.histogram) {
+        histogram.add(samples);
+    }
+}
 
 /**
- * @brief 	Parses the received JSON object looking for commands to execute
- * and appends the outputs of the called commands to the response buffer.
- * @param 	*rx_buff 	:pointer to the received buffer from the network
- * @param   **tx_buff	:pointer to pointer, will be set to the allocated return
- * buffer
- * @returns	the length of the allocated response buffer
+ * @brief   core cycles spent in the step ISR, the supervisor, the encoders
+ *          task and the JSON and binary wire protocols, measured with the DWT
+ * @details Histogram buckets are powers of two: the first one counts the
+ *          samples under "histogram_base" cycles and every other one the
+ *          samples under twice the limit of the previous one.
+ *          With "reset": true the counts start over after being reported.
  */
-int tcp_server_command::json_wp(char *rx_buff, char **tx_buff) {
-    auto rx_JSON_value = json::MyJsonDocument();
-    json::DeserializationError error = json::deserializeJson(rx_JSON_value, rx_buff);
+json::MyJsonDocument tcp_server_command::profile_cmd(json::JsonObject const pars) {
+    bool reset = pars["reset"];
 
-    auto tx_JSON_value = json::MyJsonDocument();
-    *tx_buff = NULL;
-    int buff_len = 0;
-
-    if (error) {
-        lDebug_uart_semihost(Error, "Error json parse. %s", error.c_str());
-    } else {
-        for (json::JsonVariant command : rx_JSON_value.as<json::JsonArray>()) {
-            char const *command_name = command["cmd"];
-            lDebug_uart_semihost(Info, "Command Found: %s", command_name);
-            auto pars = command["pars"];
+    json::MyJsonDocument res;
+    res["clock_hz"] = SystemCoreClock;
+    res["histogram_base"] = cycle_stats::FIRST_BUCKET_CYCLES;
+    cycles_to_json(res["step_isr"].to<json::JsonObject>(), step_isr_cycles, reset);
+    cycles_to_json(res["supervise"].to<json::JsonObject>(), supervise_cycles, reset);
+    cycles_to_json(res["encoders"].to<json::JsonObject>(), encoders_cycles, reset);
+    cycles_to_json(res["json_wp"].to<json::JsonObject>(), json_wp_cycles, reset);
+    cycles_to_json(res["bin_wp"].to<json::JsonObject>(), bin_wp_cycles, reset);
+    return res;
+}
 
-            auto ans = cmd_execute(command_name, pars);
-            tx_JSON_value[command_name] = ans;
-        }
+// From COMMANDS, as command_protocol::cmds_names[], so its index is the opcode
+#define COMMAND_ENTRY(name, function) { name, &tcp_server_command::function },
+constexpr tcp_server_command::cmd_entry tcp_server_command::cmds_table[] = { COMMANDS(COMMAND_ENTRY) };
+#undef COMMAND_ENTRY
 
-        buff_len = json::measureJson(tx_JSON_value); /* returns 0 on fail */
-        buff_len++;
-        *tx_buff = new char[buff_len];
-        if (!(*tx_buff)) {
-            lDebug_uart_semihost(Error, "Out Of Memory");
-            buff_len = 0;
-        } else {
-            json::serializeJson(tx_JSON_value, *tx_buff, buff_len);
-            lDebug_uart_semihost(Info, "%s", *tx_buff);
-        }
+/**
+ * @brief 	executes the command at the opcode index of cmds_table[]
+ * @returns its answer, or "UNKNOWN COMMAND"
+ */
+json::MyJsonDocument tcp_server_command::cmd_execute(std::size_t opcode, json::JsonObject const pars) {
+    if (opcode < cmds_count) {
+        return (this->*(cmds_table[opcode].cmd_function))(pars);
     }
-    return buff_len;
-}
+    lDebug_uart_semihost(Error, "No matching command found");
+    json::MyJsonDocument res;
+    res.set("UNKNOWN COMMAND");
+    return res;
+};
@@ -31,6 +31,7 @@ tmr::tmr() {
     // Chip_TIMER_Reset(lpc_timer);
     // Chip_TIMER_MatchEnableInt(lpc_timer, 1);
     // Chip_TIMER_ResetOnMatchEnable(lpc_timer, 1);
+    // tim->CR1 |= TIM_CR1_ARPE;   // the period is preloaded, see set_period()
 }
 
 /**
@@ -52,11 +53,35 @@ int32_t tmr::set_freq(uint32_t tick_rate_hz) {
     //timerFreq = Chip_Clock_GetRate(clk_mx_timer);
 
     tick_rate_hz = tick_rate_hz << 1; // Double the frequency
+    timerFreq = get_clock_hz();
     /* Timer setup for match at tick_rate_hz */
     //Chip_TIMER_SetMatch(lpc_timer, 1, (timerFreq / tick_rate_hz));
+    set_period(tick_rate_hz ? timerFreq / tick_rate_hz : 0);
     return 0;
 }
 
+/**
+ * @brief   sets the timer counts between matches, without stopping the timer
+ * @param   period  : timer counts, at the rate returned by get_clock_hz()
+ * @note    meant to be called from the timer ISR on every match. The auto
+ *          reload register is preloaded, the new period is copied to its
+ *          shadow on the next update event, so the running period is never
+ *          cut short nor stretched.
+ */
+void tmr::set_period(uint32_t period) {
+    this->period = period;
+    // tim->ARR = period - 1;
+}
+
+/**
+ * @brief   rate the timer counts at
+ * @returns SYSCLK / 2, APB timers run at twice their bus clock, which is
+ *          SYSCLK / 4 with the D1 and D2 prescalers at /2
+ */
+uint32_t tmr::get_clock_hz() const {
+    return SystemCoreClock / 2;
+}
+
 /**
  * @brief   changes timer frequency
  * @param   tick_rate_hz    : desired frequency
@@ -22,8 +22,7 @@
 #include "rema.h"
 #include "settings.h"
 //#include "temperature_ds18b20.h"
-#include "xy_axes.h"
-#include "z_axis.h"
+#include "xyz_axes.h"
 
 /* GPa 201117 1850 Iss2: agregado de Heap_4.c*/
 uint8_t __attribute__((section("."
@@ -64,7 +63,7 @@ extern "C" int user_main(void) {
     debugLocalSetLevel(true, Info);
     debugNetSetLevel(true, Info);
 
-    //prvSetupHardware();
+    prvSetupHardware();
 
     printf("    --- NASA GSPC ---\n");
     printf("REMA Remote Terminal Unit.\n");
@@ -72,8 +71,7 @@ extern "C" int user_main(void) {
     settings::init();
 
     rema::init_input_outputs();
-    xy_axes_init();
-    //z_axis_init();
+    xyz_axes_init();
     encoders_pico_init();
 
     //temperature_ds18b20_init();
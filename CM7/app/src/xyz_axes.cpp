@@ -0,0 +1,74 @@
+#include <cstdint>
+#include <new>
+
+#include "FreeRTOS.h"
+#include "bresenham.h"
+#include "queue.h"
+#include "semphr.h"
+#include "task.h"
+#include "xyz_axes.h"
+
+#include "../inc/debug.h"
+#include "gpio.h"
+#include "tmr.h"
+
+/**
+ * @brief   initializes the stepper motors for bresenham control
+ * @returns	nothing
+ */
+xyz_bresenham &xyz_axes_init() {
+    static mot_pap x_axis(
+        x_axis_traits{},
+        25000, // motor resolution
+        500,   // encoder resolution
+        10     // turns_per_inch
+    );
+
+    static mot_pap y_axis(
+        y_axis_traits{},
+        25000, // motor resolution
+        500,   // encoder resolution
+        10     // turns_per_inch
+    );
+
+    static mot_pap z_axis(
+        z_axis_traits{},
+        25000, // motor resolution
+        500,   // encoder resolution
+        10     // turns_per_inch
+    );
+
+    static tmr x_y_z_axes_tmr = tmr(); //(LPC_TIMER0, RGU_TIMER0_RST, CLK_MX_TIMER0, TIMER0_IRQn);
+    alignas(xyz_bresenham) static char x_y_z_axes_buf[sizeof(xyz_bresenham)];
+
+    x_y_z_axes = new (x_y_z_axes_buf) xyz_bresenham("xyz_axes", { &x_axis, &y_axis, &z_axis }, x_y_z_axes_tmr, true);
+    x_y_z_axes->profile.min_freq = 10000;        //!< Start and stop frequency
+    x_y_z_axes->profile.max_freq = 60000;        //!< Cruise frequency
+    x_y_z_axes->planner.acceleration = 2000;     //!< counts/s^2
+    x_y_z_axes->planner.jerk = 20000;            //!< counts/s^3
+    x_y_z_axes->planner.junction_deviation = 10; //!< counts
+    x_y_z_axes->dma_steps = false;               //!< Steps output by the ISR until step_dma programs the registers
+
+    return *x_y_z_axes;
+}
+
+/**
+ * @brief   handle interrupt from 32-bit timer to generate pulses for the
+ * stepper motor drivers
+ * @returns nothing
+ * @note    calls the supervisor task every x number of generated steps
+ */
+extern "C" void TIMER0_IRQHandler(void) {
+    if (x_y_z_axes->tmr.match_pending()) {
+        x_y_z_axes->isr();
+    }
+}
+
+/**
+ * @brief   handle interrupt from the DMA streams that output the step
+ * schedule, every time they are done with one half of it
+ * @returns nothing
+ */
+extern "C" void DMA1_Stream0_IRQHandler(void) {
+    x_y_z_axes->dma_isr();
+}
@@ -0,0 +1,206 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "debug.h"
+#include "encoders_pico.h"
+#include "mot_pap.h"
+#include "pico_emulator.h"
+#include "rema.h"
+#include "sim.h"
+#include "xyz_axes.h"
+
+extern "C" void TIMER0_IRQHandler(void);
+extern "C" void DMA1_Stream0_IRQHandler(void);
+extern "C" void GPIO0_IRQHandler(void);
+
+namespace {
+constexpr double PI = 3.14159265358979323846;
+constexpr int RADIUS = 3000;      // counts, the circle goes through the origin
+constexpr int POLYGON_SIDES = 72; // MOVE_CLOSED_LOOP commands of the approximation
+constexpr int SPEED_WINDOW_MS = 10;
+constexpr int TIMEOUT_MS = 20000;
+constexpr int SETTLE_MS = 100;
+
+struct sample {
+    uint64_t ns;
+    double x;
+    double y;
+};
+
+struct result {
+    int commands;
+    double seconds;         // virtual, from the first command to the stop
+    double max_deviation;   // counts off the circle
+    double speed;           // mean tangential speed while cruising, counts/s
+    double speed_variation; // max deviation from it, relative
+    int end_error;          // counts off the end, of any axis
+    bool reached;
+};
+
+double encoder_position(mot_pap const *axis) {
+    double counts = pico_emulator::position(axis->name);
+    return axis->reversed_encoder ? -counts : counts;
+}
+
+void home() {
+    for (mot_pap *axis : x_y_z_axes->axes) {
+        axis->set_position(0);
+    }
+    vTaskDelay(pdMS_TO_TICKS(10));
+}
+
+/**
+ * @brief   follows the axes until they stop, sampling the emulated encoders
+ *          every millisecond, and measures how far off the circle they went
+ *          and how constant the tangential speed was, in the middle half of
+ *          the move
+ */
+result follow(uint64_t start_ns) {
+    result r = {};
+    std::vector<sample> samples;
+    mot_pap *x = x_y_z_axes->axes[0];
+    mot_pap *y = x_y_z_axes->axes[1];
+
+    TickType_t start = xTaskGetTickCount();
+    vTaskDelay(1);
+    while (x_y_z_axes->is_moving && xTaskGetTickCount() - start < pdMS_TO_TICKS(TIMEOUT_MS)) {
+        // Timed at the last step output, not at the sampling, which jitters
+        uint64_t ns = std::max(sim::gpio_last_rising_edge_ns(x_axis_traits::step::port(), x_axis_traits::step::mask),
+                               sim::gpio_last_rising_edge_ns(y_axis_traits::step::port(), y_axis_traits::step::mask));
+        samples.push_back({ ns, encoder_position(x), encoder_position(y) });
+        vTaskDelay(1);
+    }
+    r.seconds = (sim::now_ns() - start_ns) / 1e9;
+
+    for (sample const &s : samples) {
+        r.max_deviation = std::max(r.max_deviation, std::fabs(std::hypot(s.x + RADIUS, s.y) - RADIUS));
+    }
+
+    std::vector<double> speeds;
+    for (std::size_t i = samples.size() / 4; i + SPEED_WINDOW_MS < samples.size() * 3 / 4; i += SPEED_WINDOW_MS) {
+        sample const &a = samples[i];
+        sample const &b = samples[i + SPEED_WINDOW_MS];
+        speeds.push_back(std::hypot(b.x - a.x, b.y - a.y) * 1e9 / (b.ns - a.ns));
+    }
+    for (double speed : speeds) {
+        r.speed += speed / speeds.size();
+    }
+    for (double speed : speeds) {
+        r.speed_variation = std::max(r.speed_variation, std::fabs(speed - r.speed) / r.speed);
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(SETTLE_MS));
+    r.reached = x_y_z_axes->already_there && !x_y_z_axes->is_moving;
+    for (mot_pap *axis : x_y_z_axes->axes) {
+        r.end_error = std::max(r.end_error, std::abs(pico_emulator::counter(axis->name)));
+    }
+    return r;
+}
+
+/**
+ * @brief   a whole circle, counterclockwise from the origin, with one ARC
+ */
+result arc() {
+    home();
+    bresenham_msg<3> msg = { mot_pap::type::ARC, { 0, 0, 0 }, { { 0, 1 }, { -RADIUS, 0 }, false } };
+    uint64_t start_ns = sim::now_ns();
+    x_y_z_axes->send(msg);
+    result r = follow(start_ns);
+    r.commands = 1;
+    return r;
+}
+
+/**
+ * @brief   the same circle, as a polygon of MOVE_CLOSED_LOOP commands queued
+ *          in the path, the way the clients draw circles today
+ */
+result polygon() {
+    home();
+    uint64_t start_ns = sim::now_ns();
+    for (int i = 1; i <= POLYGON_SIDES; i++) {
+        double angle = 2 * PI * i / POLYGON_SIDES;
+        x_y_z_axes->send({ mot_pap::type::MOVE,
+                           { static_cast<int>(lround(RADIUS * (cos(angle) - 1))), static_cast<int>(lround(RADIUS * sin(angle))), 0 } });
+    }
+    result r = follow(start_ns);
+    r.commands = POLYGON_SIDES;
+    return r;
+}
+
+void print(char const *name, result const &r) {
+    printf("%-24s %8d %8.3f %10.2f %10.0f %10.2f %8d %8s\n",
+           name,
+           r.commands,
+           r.seconds,
+           r.max_deviation,
+           r.speed,
+           100 * r.speed_variation,
+           r.end_error,
+           r.reached ? "yes" : "no");
+}
+
+void keep_alive_task(void *) {
+    while (true) {
+        rema::update_watchdog_timer();
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+void bench_task(void *) {
+    rema::control_enabled_set(true);
+    // The emulator counts in the direction last written over SPI, the
+    // reversals of the polygon would be taken for stalls now and then
+    rema::stall_control = false;
+    x_y_z_axes->has_brakes = false;
+    x_y_z_axes->planner.acceleration = 10000; // so the circle is mostly cruised
+    vTaskDelay(pdMS_TO_TICKS(10)); // encoders_pico::task() programs the thresholds
+
+    bool failed = false;
+    for (bool dma_steps : { false, true }) {
+        x_y_z_axes->dma_steps = dma_steps;
+        printf("%s, circle of radius %d counts\n", dma_steps ? "DMA schedules" : "ISR", RADIUS);
+        printf("%-24s %8s %8s %10s %10s %10s %8s %8s\n", "", "commands", "s", "deviation", "speed", "speed %", "error", "reached");
+
+        result by_arc = arc();
+        print("ARC", by_arc);
+        result by_polygon = polygon();
+        print("MOVE_CLOSED_LOOP polygon", by_polygon);
+
+        failed |= !by_arc.reached || by_arc.end_error > MOT_PAP_POS_THRESHOLD || by_arc.max_deviation > 1;
+        failed |= by_arc.speed_variation > 0.02;
+    }
+    exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+} // namespace
+
+int main() {
+    sim::init();
+    debugInit();
+
+    rema::init_input_outputs();
+    xyz_axes_init();
+    encoders_pico_init();
+
+    pico_emulator::attach_axis<x_axis_traits>(*x_y_z_axes->axes[0]);
+    pico_emulator::attach_axis<y_axis_traits>(*x_y_z_axes->axes[1]);
+    pico_emulator::attach_axis<z_axis_traits>(*x_y_z_axes->axes[2]);
+    pico_emulator::irq_attach(GPIO0_IRQHandler);
+
+    sim::timer_attach(&x_y_z_axes->tmr, TIMER0_IRQHandler);
+    sim::dma_attach(&x_y_z_axes->tmr, &x_y_z_axes->dma, DMA1_Stream0_IRQHandler);
+    sim::timer_task_create();
+
+    xTaskCreate(keep_alive_task, "keep_alive", configMINIMAL_STACK_SIZE * 2, nullptr, tskIDLE_PRIORITY + 2, nullptr);
+    xTaskCreate(bench_task, "bench", configMINIMAL_STACK_SIZE * 4, nullptr, tskIDLE_PRIORITY + 1, nullptr);
+
+    vTaskStartScheduler();
+    return EXIT_FAILURE;
+}
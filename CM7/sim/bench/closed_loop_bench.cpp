@@ -0,0 +1,238 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cycles.h"
+#include "debug.h"
+#include "encoders_pico.h"
+#include "mot_pap.h"
+#include "pico_emulator.h"
+#include "rema.h"
+#include "sim.h"
+#include "xyz_axes.h"
+
+extern "C" void TIMER0_IRQHandler(void);
+extern "C" void DMA1_Stream0_IRQHandler(void);
+extern "C" void GPIO0_IRQHandler(void);
+
+namespace {
+constexpr int TRIALS = 10;
+constexpr int MAX_SETPOINT = 5000; // counts
+constexpr int TRAVEL = 20000;      // counts, for the hard limits trial
+constexpr int TIMEOUT_MS = 10000;
+constexpr int SETTLE_MS = 100;
+constexpr int STALL_AFTER_MS = 500;
+
+struct result {
+    int trials;
+    int reached;     // stopped by the targets flags of the encoders
+    int max_error;   // counts off the setpoint, of any axis
+    double time_sum; // virtual seconds from the command to the stop
+    double time_max;
+    uint32_t irqs;
+};
+
+/**
+ * @returns the position of an axis as the firmware sees it, straight from
+ *          the emulated encoder
+ */
+int encoder_position(mot_pap const *axis) {
+    int32_t counts = pico_emulator::counter(axis->name);
+    return axis->reversed_encoder ? -counts : counts;
+}
+
+struct estimate_error {
+    double observer_sum;
+    double observer_max;
+    double snapshot_sum;
+    double snapshot_max;
+    double following_max; // of the commanded position, while moving
+    uint32_t samples;
+} estimate_errors;
+
+/**
+ * @brief   compares the position the firmware would use, from the observer
+ *          and from the last published snapshot, with the encoder
+ */
+void sample_estimates() {
+    struct encoders_snapshot snapshot = encoders->latest();
+    for (mot_pap *axis : x_y_z_axes->axes) {
+        int position = encoder_position(axis);
+        int32_t counts = snapshot.counter(axis->name);
+        double observer = std::fabs(axis->estimated_counts() - position);
+        double last = std::abs((axis->reversed_encoder ? -counts : counts) - position);
+        estimate_errors.observer_sum += observer;
+        estimate_errors.observer_max = std::max(estimate_errors.observer_max, observer);
+        estimate_errors.snapshot_sum += last;
+        estimate_errors.snapshot_max = std::max(estimate_errors.snapshot_max, last);
+        if (x_y_z_axes->is_moving) {
+            estimate_errors.following_max =
+                std::max(estimate_errors.following_max, static_cast<double>(std::fabs(axis->following_error())));
+        }
+        estimate_errors.samples++;
+    }
+}
+
+/**
+ * @brief   waits until the axes stop, or the timeout
+ * @returns the virtual seconds it took
+ */
+double wait_stop(uint64_t start_ns) {
+    TickType_t start = xTaskGetTickCount();
+    vTaskDelay(pdMS_TO_TICKS(10));
+    while (x_y_z_axes->is_moving && xTaskGetTickCount() - start < pdMS_TO_TICKS(TIMEOUT_MS)) {
+        vTaskDelay(1);
+        sample_estimates();
+    }
+    return (sim::now_ns() - start_ns) / 1e9;
+}
+
+/**
+ * @brief   moves from the origin to random setpoints, finished in closed
+ *          loop on the emulated encoders
+ */
+result positioning(bool dma_steps) {
+    result r = {};
+    x_y_z_axes->dma_steps = dma_steps;
+
+    srand(1);
+    for (int trial = 0; trial < TRIALS; trial++) {
+        for (mot_pap *axis : x_y_z_axes->axes) {
+            axis->set_position(0);
+        }
+
+        std::array<int, 3> setpoints;
+        for (int &setpoint : setpoints) {
+            setpoint = (rand() % (2 * MAX_SETPOINT)) - MAX_SETPOINT;
+        }
+
+        pico_emulator::stats_reset();
+        uint64_t start_ns = sim::now_ns();
+        x_y_z_axes->send({ mot_pap::type::MOVE, setpoints });
+        double elapsed = wait_stop(start_ns);
+        vTaskDelay(pdMS_TO_TICKS(SETTLE_MS));
+
+        for (std::size_t i = 0; i < 3; i++) {
+            r.max_error = std::max(r.max_error, std::abs(encoder_position(x_y_z_axes->axes[i]) - setpoints[i]));
+        }
+        r.reached += x_y_z_axes->already_there;
+        r.time_sum += elapsed;
+        r.time_max = std::max(r.time_max, elapsed);
+        r.irqs += pico_emulator::stats_get().irqs;
+        r.trials++;
+    }
+    return r;
+}
+
+void print(char const *name, result const &r) {
+    printf("%-24s %4d/%-4d %8d %10.3f %10.3f %8.1f\n",
+           name,
+           r.reached,
+           r.trials,
+           r.max_error,
+           r.time_sum / r.trials,
+           r.time_max,
+           static_cast<double>(r.irqs) / r.trials);
+}
+
+/**
+ * @brief   keeps the watchdog fed while the bench task is blocked
+ */
+void keep_alive_task(void *) {
+    while (true) {
+        rema::update_watchdog_timer();
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+void bench_task(void *) {
+    rema::control_enabled_set(true);
+    rema::stall_control = true;
+    x_y_z_axes->has_brakes = false;
+    vTaskDelay(pdMS_TO_TICKS(10)); // encoders_pico::task() programs the thresholds
+
+    printf("%-24s %9s %8s %10s %10s %8s\n", "steps", "reached", "error", "mean s", "max s", "IRQs");
+    result by_isr = positioning(false);
+    print("ISR", by_isr);
+    result by_dma = positioning(true);
+    print("DMA schedules", by_dma);
+
+    // Hard limits: X runs into the upper end of its travel
+    mot_pap *x = x_y_z_axes->axes[0];
+    x->set_position(0);
+    pico_emulator::set_travel(x->name, -TRAVEL, TRAVEL);
+    uint64_t start_ns = sim::now_ns();
+    x_y_z_axes->send({ mot_pap::type::MOVE, { 2 * TRAVEL, 0, 0 } });
+    double elapsed = wait_stop(start_ns);
+    int overrun = encoder_position(x) - TRAVEL;
+    bool hard_stopped = !x_y_z_axes->is_moving;
+    printf("hard limit:              %s after %.3f s, %d counts past it\n",
+           hard_stopped ? "stopped" : "not stopped",
+           elapsed,
+           overrun);
+
+    double following_max = estimate_errors.following_max; // the stall one is expected to exceed the window
+
+    // Stall: X is blocked in the middle of a move
+    pico_emulator::set_travel(x->name, INT32_MIN, INT32_MAX);
+    rema::control_enabled_set(true);
+    x->set_position(0);
+    x_y_z_axes->send({ mot_pap::type::MOVE, { TRAVEL / 2, 0, 0 } });
+    vTaskDelay(pdMS_TO_TICKS(STALL_AFTER_MS));
+    pico_emulator::set_stalled(x->name, true);
+    start_ns = sim::now_ns();
+    double stall_elapsed = wait_stop(start_ns);
+    bool stall_detected = !x_y_z_axes->is_moving && x->stalled;
+    printf("stall:                   %s after %.1f ms, window %d counts\n",
+           stall_detected ? "detected" : "not detected",
+           stall_elapsed * 1e3,
+           x->following_error_window);
+    pico_emulator::set_stalled(x->name, false);
+    if (x_y_z_axes->is_moving) {
+        x_y_z_axes->stop();
+    }
+
+    estimate_error const &e = estimate_errors;
+    printf("position while moving:   observer %.2f mean, %.2f max; last snapshot %.2f mean, %.2f max counts off\n",
+           e.observer_sum / e.samples,
+           e.observer_max,
+           e.snapshot_sum / e.samples,
+           e.snapshot_max);
+    printf("following error:         %.2f max counts while moving, before the stall\n", following_max);
+
+    cycle_stats encoders = encoders_cycles.snapshot();
+    printf("encoders_pico::task():   %u iterations, mean %u cycles, max %u cycles\n", encoders.count, encoders.mean(), encoders.max);
+
+    bool failed = by_isr.reached != TRIALS || by_dma.reached != TRIALS || !hard_stopped || !stall_detected;
+    exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+} // namespace
+
+int main() {
+    sim::init();
+    debugInit();
+
+    rema::init_input_outputs();
+    xyz_axes_init();
+    encoders_pico_init();
+
+    pico_emulator::attach_axis<x_axis_traits>(*x_y_z_axes->axes[0]);
+    pico_emulator::attach_axis<y_axis_traits>(*x_y_z_axes->axes[1]);
+    pico_emulator::attach_axis<z_axis_traits>(*x_y_z_axes->axes[2]);
+    pico_emulator::irq_attach(GPIO0_IRQHandler);
+
+    sim::timer_attach(&x_y_z_axes->tmr, TIMER0_IRQHandler);
+    sim::dma_attach(&x_y_z_axes->tmr, &x_y_z_axes->dma, DMA1_Stream0_IRQHandler);
+    sim::timer_task_create();
+
+    xTaskCreate(keep_alive_task, "keep_alive", configMINIMAL_STACK_SIZE * 2, nullptr, tskIDLE_PRIORITY + 2, nullptr);
+    xTaskCreate(bench_task, "bench", configMINIMAL_STACK_SIZE * 2, nullptr, tskIDLE_PRIORITY + 1, nullptr);
+
+    vTaskStartScheduler();
+    return EXIT_FAILURE;
+}
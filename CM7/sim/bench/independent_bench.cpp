@@ -0,0 +1,183 @@
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "debug.h"
+#include "encoders_pico.h"
+#include "mot_pap.h"
+#include "pico_emulator.h"
+#include "rema.h"
+#include "sim.h"
+#include "xyz_axes.h"
+
+extern "C" void TIMER0_IRQHandler(void);
+extern "C" void DMA1_Stream0_IRQHandler(void);
+extern "C" void GPIO0_IRQHandler(void);
+
+namespace {
+constexpr int TIMEOUT_MS = 20000;
+constexpr int SETTLE_MS = 100;
+constexpr int RETARGET_MS = 300;
+
+struct result {
+    double seconds;  // virtual, from the first command to the last stop
+    double y_seconds; // until Y got to its setpoint
+    int max_error;   // counts off the setpoints, of any axis
+    bool reached;
+};
+
+int encoder_position(mot_pap const *axis) {
+    int32_t counts = pico_emulator::counter(axis->name);
+    return axis->reversed_encoder ? -counts : counts;
+}
+
+void home() {
+    for (mot_pap *axis : x_y_z_axes->axes) {
+        axis->set_position(0);
+    }
+}
+
+/**
+ * @brief   waits until the axes stop, or the timeout, noting when Y got
+ *          within the position threshold of its setpoint
+ */
+void wait_stop(uint64_t start_ns, int y_setpoint, result &r) {
+    TickType_t start = xTaskGetTickCount();
+    vTaskDelay(pdMS_TO_TICKS(10));
+    while (x_y_z_axes->is_moving && xTaskGetTickCount() - start < pdMS_TO_TICKS(TIMEOUT_MS)) {
+        if (!r.y_seconds && std::abs(encoder_position(x_y_z_axes->axes[1]) - y_setpoint) <= MOT_PAP_POS_THRESHOLD) {
+            r.y_seconds = (sim::now_ns() - start_ns) / 1e9;
+        }
+        vTaskDelay(1);
+    }
+    r.seconds = (sim::now_ns() - start_ns) / 1e9;
+    if (!r.y_seconds) {
+        r.y_seconds = r.seconds;
+    }
+}
+
+void finish(std::array<int, 3> const &setpoints, result &r) {
+    vTaskDelay(pdMS_TO_TICKS(SETTLE_MS));
+    r.reached = x_y_z_axes->already_there && !x_y_z_axes->is_moving;
+    for (std::size_t i = 0; i < 3; i++) {
+        r.max_error = std::max(r.max_error, std::abs(encoder_position(x_y_z_axes->axes[i]) - setpoints[i]));
+    }
+}
+
+/**
+ * @brief   X and then Y, one coupled move after the other, as the alignment
+ *          routines do today
+ */
+result serialized(std::array<int, 3> const &setpoints) {
+    result r = {};
+    home();
+    uint64_t start_ns = sim::now_ns();
+    x_y_z_axes->send({ mot_pap::type::MOVE, { setpoints[0], 0, 0 } });
+    wait_stop(start_ns, 0, r);
+    r = {};
+    x_y_z_axes->send({ mot_pap::type::MOVE, setpoints });
+    wait_stop(start_ns, setpoints[1], r);
+    finish(setpoints, r);
+    return r;
+}
+
+/**
+ * @brief   X and Y at once, each one with its own profile
+ */
+result independent(std::array<int, 3> const &setpoints) {
+    result r = {};
+    home();
+    uint64_t start_ns = sim::now_ns();
+    x_y_z_axes->send({ mot_pap::type::MOVE_INDEPENDENT, setpoints });
+    wait_stop(start_ns, setpoints[1], r);
+    finish(setpoints, r);
+    return r;
+}
+
+/**
+ * @brief   X is sent back the other way while Y keeps going
+ */
+result retargeted(std::array<int, 3> const &first, std::array<int, 3> const &setpoints) {
+    result r = {};
+    home();
+    uint64_t start_ns = sim::now_ns();
+    x_y_z_axes->send({ mot_pap::type::MOVE_INDEPENDENT, first });
+    vTaskDelay(pdMS_TO_TICKS(RETARGET_MS));
+    x_y_z_axes->send({ mot_pap::type::MOVE_INDEPENDENT, { setpoints[0], x_y_z_axes->hold_setpoint(1), x_y_z_axes->hold_setpoint(2) } });
+    wait_stop(start_ns, setpoints[1], r);
+    finish(setpoints, r);
+    return r;
+}
+
+void print(char const *name, result const &r) {
+    printf("%-28s %8s %8d %10.3f %10.3f\n", name, r.reached ? "yes" : "no", r.max_error, r.y_seconds, r.seconds);
+}
+
+void keep_alive_task(void *) {
+    while (true) {
+        rema::update_watchdog_timer();
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+void bench_task(void *) {
+    rema::control_enabled_set(true);
+    rema::stall_control = true;
+    x_y_z_axes->has_brakes = false;
+    vTaskDelay(pdMS_TO_TICKS(10)); // encoders_pico::task() programs the thresholds
+
+    bool failed = false;
+    for (bool dma_steps : { false, true }) {
+        x_y_z_axes->dma_steps = dma_steps;
+        printf("%s\n", dma_steps ? "DMA schedules" : "ISR");
+        printf("%-28s %8s %8s %10s %10s\n", "", "reached", "error", "Y s", "total s");
+
+        std::array<int, 3> setpoints = { 4000, -3000, 0 };
+        result by_path = serialized(setpoints);
+        print("X then Y, coupled", by_path);
+        result by_axis = independent(setpoints);
+        print("X and Y, independent", by_axis);
+
+        result y_alone = independent({ 0, 6000, 0 });
+        print("Y alone", y_alone);
+        result reversed = retargeted({ 6000, 6000, 0 }, { -2000, 6000, 0 });
+        print("X reversed while Y moves", reversed);
+
+        for (result const &r : { by_path, by_axis, y_alone, reversed }) {
+            failed |= !r.reached || r.max_error > MOT_PAP_POS_THRESHOLD;
+        }
+        failed |= by_axis.seconds >= by_path.seconds;
+        failed |= reversed.y_seconds > y_alone.y_seconds * 1.01;
+    }
+    exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+} // namespace
+
+int main() {
+    sim::init();
+    debugInit();
+
+    rema::init_input_outputs();
+    xyz_axes_init();
+    encoders_pico_init();
+
+    pico_emulator::attach_axis<x_axis_traits>(*x_y_z_axes->axes[0]);
+    pico_emulator::attach_axis<y_axis_traits>(*x_y_z_axes->axes[1]);
+    pico_emulator::attach_axis<z_axis_traits>(*x_y_z_axes->axes[2]);
+    pico_emulator::irq_attach(GPIO0_IRQHandler);
+
+    sim::timer_attach(&x_y_z_axes->tmr, TIMER0_IRQHandler);
+    sim::dma_attach(&x_y_z_axes->tmr, &x_y_z_axes->dma, DMA1_Stream0_IRQHandler);
+    sim::timer_task_create();
+
+    xTaskCreate(keep_alive_task, "keep_alive", configMINIMAL_STACK_SIZE * 2, nullptr, tskIDLE_PRIORITY + 2, nullptr);
+    xTaskCreate(bench_task, "bench", configMINIMAL_STACK_SIZE * 2, nullptr, tskIDLE_PRIORITY + 1, nullptr);
+
+    vTaskStartScheduler();
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,184 @@
+#include <algorithm>
+#include <array>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "debug.h"
+#include "encoders_pico.h"
+#include "mot_pap.h"
+#include "pico_emulator.h"
+#include "rema.h"
+#include "sim.h"
+#include "xyz_axes.h"
+
+extern "C" void TIMER0_IRQHandler(void);
+extern "C" void DMA1_Stream0_IRQHandler(void);
+extern "C" void GPIO0_IRQHandler(void);
+
+namespace {
+constexpr double PI = 3.14159265358979323846;
+constexpr int UPDATE_MS = 10;       // joystick updates at 100 Hz
+constexpr int UPDATES = 400;        // 4 s
+constexpr double AMPLITUDE = 1000;  // counts/s, X follows a sine and Y a cosine of it
+constexpr double PERIOD = 4;        // s, so the acceleration stays under the max one
+constexpr double LOOKAHEAD = 0.25;  // s, of the setpoints streamed with MOVE_JOYSTICK
+constexpr int WARMUP_UPDATES = 50;  // not accounted, the axes are ramping up
+constexpr int TIMEOUT_MS = 5000;
+
+struct result {
+    double transfers;         // SPI frames per update
+    double velocity_error;    // mean, counts/s
+    double max_velocity_error;
+    double stop_seconds;      // from the last update to the stop
+    bool stopped;
+};
+
+int encoder_position(mot_pap const *axis) {
+    int32_t counts = pico_emulator::counter(axis->name);
+    return axis->reversed_encoder ? -counts : counts;
+}
+
+std::array<double, 2> velocities_at(int update) {
+    double phase = 2 * PI * update * UPDATE_MS / 1000.0 / PERIOD;
+    return { AMPLITUDE * sin(phase), AMPLITUDE * cos(phase) };
+}
+
+/**
+ * @brief   streams the joystick, with setpoints ahead of the axes or with
+ *          velocities, and compares the velocities of the emulated encoders
+ *          with the requested ones
+ * @param   send_release : whether the client tells the axes to stop when
+ *                         the joystick is released, or just stops sending
+ */
+result stream(bool by_velocity, bool send_release) {
+    result r = {};
+    for (mot_pap *axis : x_y_z_axes->axes) {
+        axis->set_position(0);
+    }
+    vTaskDelay(pdMS_TO_TICKS(10));
+
+    mot_pap *x = x_y_z_axes->axes[0];
+    mot_pap *y = x_y_z_axes->axes[1];
+    std::array<int, 2> last = { encoder_position(x), encoder_position(y) };
+    uint64_t last_ns = sim::now_ns();
+    std::array<double, 2> requested = { 0, 0 };
+    uint32_t errors = 0;
+
+    pico_emulator::stats_reset();
+    for (int update = 0; update < UPDATES; update++) {
+        std::array<double, 2> v = velocities_at(update);
+        if (by_velocity) {
+            x_y_z_axes->send({ mot_pap::type::JOG_VELOCITY, { static_cast<int>(v[0]), static_cast<int>(v[1]), 0 } });
+        } else {
+            x_y_z_axes->send({ mot_pap::type::MOVE_JOYSTICK,
+                               { static_cast<int>(x->current_counts + v[0] * LOOKAHEAD),
+                                 static_cast<int>(y->current_counts + v[1] * LOOKAHEAD),
+                                 x_y_z_axes->axes[2]->current_counts } });
+        }
+        vTaskDelay(pdMS_TO_TICKS(UPDATE_MS));
+
+        std::array<int, 2> now = { encoder_position(x), encoder_position(y) };
+        uint64_t now_ns = sim::now_ns();
+        if (update >= WARMUP_UPDATES) {
+            for (int i = 0; i < 2; i++) {
+                double measured = (now[i] - last[i]) * 1e9 / (now_ns - last_ns);
+                double error = std::fabs(measured - requested[i]);
+                r.velocity_error += error;
+                r.max_velocity_error = std::max(r.max_velocity_error, error);
+                errors++;
+            }
+        }
+        last = now;
+        last_ns = now_ns;
+        requested = v;
+    }
+    r.transfers = static_cast<double>(pico_emulator::stats_get().transfers) / UPDATES;
+    r.velocity_error /= errors;
+
+    uint64_t release_ns = sim::now_ns();
+    if (send_release) {
+        if (by_velocity) {
+            x_y_z_axes->send({ mot_pap::type::JOG_VELOCITY, { 0, 0, 0 } });
+        } else {
+            x_y_z_axes->send({ mot_pap::type::SOFT_STOP, {} });
+        }
+    }
+    TickType_t start = xTaskGetTickCount();
+    while (x_y_z_axes->is_moving && xTaskGetTickCount() - start < pdMS_TO_TICKS(TIMEOUT_MS)) {
+        vTaskDelay(1);
+    }
+    r.stopped = !x_y_z_axes->is_moving;
+    r.stop_seconds = (sim::now_ns() - release_ns) / 1e9;
+    if (!r.stopped) {
+        x_y_z_axes->send({ mot_pap::type::HARD_STOP, {} });
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    return r;
+}
+
+void print(char const *name, result const &r) {
+    printf("%-32s %10.1f %10.1f %10.1f %10.3f %s\n",
+           name,
+           r.transfers,
+           r.velocity_error,
+           r.max_velocity_error,
+           r.stop_seconds,
+           r.stopped ? "" : "(not stopped)");
+}
+
+void keep_alive_task(void *) {
+    while (true) {
+        rema::update_watchdog_timer();
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+void bench_task(void *) {
+    rema::control_enabled_set(true);
+    rema::stall_control = true;
+    x_y_z_axes->has_brakes = false;
+    vTaskDelay(pdMS_TO_TICKS(10)); // encoders_pico::task() programs the thresholds
+
+    printf("%-32s %10s %10s %10s %10s\n", "100 Hz joystick", "SPI/update", "v error", "v error max", "stop s");
+    result by_setpoint = stream(false, true);
+    print("MOVE_JOYSTICK setpoints", by_setpoint);
+    result by_velocity = stream(true, true);
+    print("JOG_VELOCITY", by_velocity);
+    result released = stream(true, false);
+    print("JOG_VELOCITY, client gone", released);
+    printf("SPI frames include the ones of the encoders poller, 2 per poll at %d Hz\n", ENCODERS_PICO_POLL_RATE_HZ);
+
+    bool failed = !by_velocity.stopped || !released.stopped || by_velocity.transfers >= by_setpoint.transfers ||
+                  by_velocity.velocity_error >= by_setpoint.velocity_error;
+    exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+} // namespace
+
+int main() {
+    sim::init();
+    debugInit();
+
+    rema::init_input_outputs();
+    xyz_axes_init();
+    encoders_pico_init();
+
+    pico_emulator::attach_axis<x_axis_traits>(*x_y_z_axes->axes[0]);
+    pico_emulator::attach_axis<y_axis_traits>(*x_y_z_axes->axes[1]);
+    pico_emulator::attach_axis<z_axis_traits>(*x_y_z_axes->axes[2]);
+    pico_emulator::irq_attach(GPIO0_IRQHandler);
+
+    sim::timer_attach(&x_y_z_axes->tmr, TIMER0_IRQHandler);
+    sim::dma_attach(&x_y_z_axes->tmr, &x_y_z_axes->dma, DMA1_Stream0_IRQHandler);
+    sim::timer_task_create();
+
+    xTaskCreate(keep_alive_task, "keep_alive", configMINIMAL_STACK_SIZE * 2, nullptr, tskIDLE_PRIORITY + 2, nullptr);
+    xTaskCreate(bench_task, "bench", configMINIMAL_STACK_SIZE * 2, nullptr, tskIDLE_PRIORITY + 1, nullptr);
+
+    vTaskStartScheduler();
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,104 @@
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "cycles.h"
+#include "debug.h"
+#include "encoders_pico.h"
+#include "mot_pap.h"
+#include "rema.h"
+#include "sim.h"
+#include "xyz_axes.h"
+
+extern "C" void TIMER0_IRQHandler(void);
+
+namespace {
+constexpr int MOVES = 200;
+constexpr int MOVE_TIME_MS = 20;
+constexpr int MAX_SETPOINT = 20000;
+
+template <typename... Axes> uint32_t steps() {
+    return (sim::gpio_rising_edges(Axes::step::port(), Axes::step::mask) + ...);
+}
+
+uint32_t xyz_steps() {
+    return steps<x_axis_traits, y_axis_traits, z_axis_traits>();
+}
+
+/**
+ * @brief   streams MOVE commands to the XYZ interpolator, the way the
+ *          joystick does, and reports the step throughput and the cost of
+ *          the step ISR.
+ */
+void bench_task(void *) {
+    rema::control_enabled_set(true);
+    rema::stall_control = false; // no encoder feedback in this benchmark
+    x_y_z_axes->has_brakes = false;
+    x_y_z_axes->dma_steps = false; // the cost of the per tick ISR, see step_schedule_bench for the DMA
+
+    srand(1);
+    sim::timer_stats_reset();
+    step_isr_cycles.reset();
+    uint32_t steps_start = xyz_steps();
+    uint64_t virtual_start = sim::now_ns();
+    uint64_t host_start = sim::host_ns();
+
+    for (int i = 0; i < MOVES; i++) {
+        rema::update_watchdog_timer();
+
+        bresenham_msg<3> msg;
+        msg.type = mot_pap::type::MOVE_JOYSTICK;
+        for (int &setpoint : msg.setpoints) {
+            setpoint = (rand() % (2 * MAX_SETPOINT)) - MAX_SETPOINT;
+        }
+        x_y_z_axes->send(msg);
+
+        vTaskDelay(pdMS_TO_TICKS(MOVE_TIME_MS));
+    }
+
+    x_y_z_axes->send({ mot_pap::type::HARD_STOP });
+    vTaskDelay(pdMS_TO_TICKS(10));
+
+    uint64_t virtual_elapsed = sim::now_ns() - virtual_start;
+    uint64_t host_elapsed = sim::host_ns() - host_start;
+    uint32_t steps = xyz_steps() - steps_start;
+    sim::timer_stats stats = sim::timer_stats_get();
+
+    printf("moves:                %d\n", MOVES);
+    printf("virtual time:         %.3f s (host %.3f s)\n", virtual_elapsed / 1e9, host_elapsed / 1e9);
+    printf("steps generated:      %u\n", steps);
+    printf("mean step rate:       %.0f steps/s\n", steps / (virtual_elapsed / 1e9));
+    printf("timer ISR calls:      %llu\n", static_cast<unsigned long long>(stats.isr_calls));
+    if (stats.isr_calls) {
+        printf("ISR host cost:        %.1f ns mean, %llu ns max\n",
+               static_cast<double>(stats.isr_host_ns) / stats.isr_calls,
+               static_cast<unsigned long long>(stats.isr_host_ns_max));
+        printf("GPIO writes per ISR:  %.2f\n", static_cast<double>(stats.gpio_writes) / stats.isr_calls);
+    }
+
+    cycle_stats isr_cycles = step_isr_cycles.snapshot();
+    printf("ISR cycles (DWT):     %u mean, %u min, %u max\n", isr_cycles.mean(), isr_cycles.min, isr_cycles.max);
+
+    exit(EXIT_SUCCESS);
+}
+} // namespace
+
+int main() {
+    sim::init();
+    debugInit();
+
+    rema::init_input_outputs();
+    xyz_axes_init();
+    encoders_pico_init();
+
+    sim::timer_attach(&x_y_z_axes->tmr, TIMER0_IRQHandler);
+    sim::timer_task_create();
+
+    xTaskCreate(bench_task, "bench", configMINIMAL_STACK_SIZE * 2, nullptr, tskIDLE_PRIORITY + 1, nullptr);
+
+    vTaskStartScheduler();
+    return EXIT_FAILURE;
+}
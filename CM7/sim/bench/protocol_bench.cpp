@@ -0,0 +1,208 @@
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "command_protocol.h"
+
+namespace {
+constexpr int ITERATIONS = 100000;
+constexpr std::size_t RX_SIZE = 4096; // COMMAND_RX_SIZE
+constexpr std::size_t TX_SIZE = 4096; // COMMAND_TX_SIZE
+
+char tx_buffer[TX_SIZE];
+
+/**
+ * @brief   a command as a client sends it, and the answer of its handler.
+ *          The handlers are the same for both protocols, what the bench
+ *          measures is the work of the wire protocols around them
+ */
+struct command {
+    char const *name;
+    void (*fill_pars)(json::JsonObject pars);
+    json::MyJsonDocument (*answer)(json::JsonObject const pars);
+};
+
+struct result {
+    double ns;         // per command, host ones
+    std::size_t bytes_in;
+    std::size_t bytes_out;
+    std::size_t arena; // bytes of the arena used at most
+    bool echoed;       // the answers come back with the opcode and seq of the command
+};
+
+json::MyJsonDocument ack(json::JsonObject const pars) {
+    // Reads the parameters the way move_closed_loop_cmd() and
+    // jog_velocity_cmd() do
+    volatile double sum = 0;
+    char const *axes = pars["axes"];
+    for (char const *axis = axes ? axes : "XY"; *axis; axis++) {
+        static const char *const keys[] = { "first_axis_setpoint", "second_axis_setpoint", "third_axis_setpoint",
+                                            "first_axis_velocity", "second_axis_velocity", "third_axis_velocity" };
+        for (char const *key : keys) {
+            sum = sum + pars[key].as<double>();
+        }
+    }
+    json::MyJsonDocument res;
+    res["ack"] = true;
+    return res;
+}
+
+json::MyJsonDocument encoders([[maybe_unused]] json::JsonObject const pars) {
+    json::MyJsonDocument res;
+    res["X"] = 123456;
+    res["Y"] = -65432;
+    res["Z"] = 789;
+    return res;
+}
+
+json::MyJsonDocument version([[maybe_unused]] json::JsonObject const pars) {
+    json::MyJsonDocument res;
+    res["version"] = "JSON_1.0";
+    auto versions = res["versions"].to<json::JsonArray>();
+    versions.add("JSON_1.0");
+    versions.add("BIN_1.0");
+    return res;
+}
+
+const command commands[] = {
+    { "PROTOCOL_VERSION", [](json::JsonObject) {}, version },
+    { "READ_ENCODERS", [](json::JsonObject) {}, encoders },
+    { "MOVE_CLOSED_LOOP",
+      [](json::JsonObject pars) {
+          pars["axes"] = "XY";
+          pars["first_axis_setpoint"] = 1.2345;
+          pars["second_axis_setpoint"] = -0.5;
+      },
+      ack },
+    { "JOG_VELOCITY",
+      [](json::JsonObject pars) {
+          pars["axes"] = "XY";
+          pars["first_axis_velocity"] = 0.75;
+          pars["second_axis_velocity"] = -0.25;
+      },
+      ack },
+};
+
+/**
+ * @brief   the wire protocols of the command server, over the handlers of
+ *          the bench instead of the ones that move the axes
+ */
+class bench_protocol : public command_protocol {
+  public:
+    json::MyJsonDocument cmd_execute(std::size_t opcode, json::JsonObject const pars) override {
+        for (command const &cmd : commands) {
+            if (static_cast<std::size_t>(cmd_index(cmd.name)) == opcode) {
+                return cmd.answer(pars);
+            }
+        }
+        json::MyJsonDocument res;
+        res.set("UNKNOWN COMMAND");
+        return res;
+    }
+
+    ArenaAllocator &documents_arena() {
+        return arena;
+    }
+};
+
+bench_protocol protocol;
+
+template <typename F> double time_ns(F fn) {
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < ITERATIONS; i++) {
+        fn(i);
+    }
+    std::chrono::duration<double, std::nano> elapsed = std::chrono::steady_clock::now() - start;
+    return elapsed.count() / ITERATIONS;
+}
+
+result by_json(command const &cmd) {
+    json::MyJsonDocument request;
+    auto entry = request.to<json::JsonArray>().add<json::JsonObject>();
+    entry["cmd"] = cmd.name;
+    cmd.fill_pars(entry["pars"].to<json::JsonObject>());
+
+    static char message[RX_SIZE];
+    static char rx_buffer[RX_SIZE];
+    std::size_t len = json::serializeJson(request, message, sizeof(message) - 1);
+    message[len] = '\0';
+
+    result r = { 0, len + 1, 0, 0, true }; // and its delimiter
+    ArenaAllocator &arena = protocol.documents_arena();
+    arena.high_water = 0;
+    r.ns = time_ns([&](int) {
+        memcpy(rx_buffer, message, len + 1); // the reassembly buffer, parsed in place
+        json::ArenaScope scope(arena);
+        r.bytes_out = protocol.json_wp(rx_buffer, tx_buffer, sizeof(tx_buffer));
+    });
+    r.arena = arena.high_water;
+    return r;
+}
+
+result by_bin(command const &cmd) {
+    json::MyJsonDocument pars;
+    cmd.fill_pars(pars.to<json::JsonObject>());
+
+    static char message[RX_SIZE];
+    std::size_t payload_len = pars.as<json::JsonObject>().size() ? json::serializeMsgPack(pars, message + sizeof(bin_header), sizeof(message) - sizeof(bin_header)) : 0;
+    uint8_t opcode = command_protocol::cmd_index(cmd.name);
+    bin_header header = { BIN_MAGIC, opcode, 0, static_cast<uint16_t>(payload_len) };
+
+    result r = { 0, sizeof(header) + payload_len, 0, 0, true };
+    ArenaAllocator &arena = protocol.documents_arena();
+    arena.high_water = 0;
+    r.ns = time_ns([&](int i) {
+        header.seq = i;
+        memcpy(message, &header, sizeof(header));
+        {
+            json::ArenaScope scope(arena);
+            r.bytes_out = protocol.bin_wp(message, r.bytes_in, tx_buffer, sizeof(tx_buffer));
+        }
+
+        bin_header answer;
+        memcpy(&answer, tx_buffer, sizeof(answer));
+        r.echoed &= r.bytes_out && answer.magic == BIN_MAGIC && answer.opcode == opcode &&
+                    answer.seq == header.seq && sizeof(answer) + answer.length == r.bytes_out;
+    });
+    r.arena = arena.high_water;
+    return r;
+}
+
+void bench_task(void *) {
+    printf("wire protocols, %d commands each, host ns, documents in a %d bytes arena\n", ITERATIONS, COMMAND_ARENA_SIZE);
+    printf("%-18s %10s %10s %10s %10s %10s %10s %8s %10s %10s\n",
+           "", "JSON ns", "BIN ns", "JSON/BIN", "JSON in", "BIN in", "JSON out", "BIN out", "JSON arena", "BIN arena");
+
+    bool failed = false;
+    for (command const &cmd : commands) {
+        result json_r = by_json(cmd);
+        result bin_r = by_bin(cmd);
+        printf("%-18s %10.0f %10.0f %9.1fx %10zu %10zu %10zu %8zu %10zu %10zu\n",
+               cmd.name,
+               json_r.ns,
+               bin_r.ns,
+               json_r.ns / bin_r.ns,
+               json_r.bytes_in,
+               bin_r.bytes_in,
+               json_r.bytes_out,
+               bin_r.bytes_out,
+               json_r.arena,
+               bin_r.arena);
+
+        failed |= !json_r.bytes_out || !bin_r.bytes_out || !bin_r.echoed;
+    }
+    exit(failed ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+} // namespace
+
+int main() {
+    xTaskCreate(bench_task, "bench", configMINIMAL_STACK_SIZE * 8, nullptr, tskIDLE_PRIORITY + 1, nullptr);
+
+    vTaskStartScheduler();
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,110 @@
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "debug.h"
+#include "encoders_pico.h"
+#include "mot_pap.h"
+#include "rema.h"
+#include "sim.h"
+#include "xyz_axes.h"
+
+extern "C" void TIMER0_IRQHandler(void);
+extern "C" void DMA1_Stream0_IRQHandler(void);
+
+namespace {
+constexpr int LINES = 10;
+constexpr int SEGMENTS_PER_LINE = 10;
+constexpr int LINE_LENGTH = 20000; // counts
+constexpr int LINE_PITCH = 200;    // counts
+
+/**
+ * @brief   scans a raster made of short collinear segments, and reports the
+ *          time it takes to reach the start of its last segment (the one
+ *          finished in closed loop, which needs the encoders)
+ */
+void scan() {
+    int segments = 0;
+    double length = 0;
+    std::array<int, 3> last = { 0, 0, 0 };
+    uint32_t seq_start = x_y_z_axes->segment_seq;
+    uint64_t virtual_start = sim::now_ns();
+
+    for (int line = 0; line < LINES; line++) {
+        for (int s = 1; s <= SEGMENTS_PER_LINE; s++) {
+            int x = LINE_LENGTH * s / SEGMENTS_PER_LINE;
+            bresenham_msg<3> msg = { mot_pap::type::MOVE, { (line & 1) ? LINE_LENGTH - x : x, line * LINE_PITCH, 0 } };
+            x_y_z_axes->send(msg);
+            length += hypot(msg.setpoints[0] - last[0], msg.setpoints[1] - last[1]);
+            last = msg.setpoints;
+            segments++;
+        }
+
+        bresenham_msg<3> msg = { mot_pap::type::MOVE, { last[0], (line + 1) * LINE_PITCH, 0 } };
+        x_y_z_axes->send(msg);
+        length += LINE_PITCH;
+        last = msg.setpoints;
+        segments++;
+    }
+
+    // The last segment is not counted
+    length -= LINE_PITCH;
+    while (x_y_z_axes->segment_seq - seq_start < static_cast<uint32_t>(segments)) {
+        vTaskDelay(1);
+    }
+
+    double elapsed = (sim::now_ns() - virtual_start) / 1e9;
+    mot_pap *x = x_y_z_axes->axes[0];
+    printf("segments:             %d\n", segments);
+    printf("virtual time:         %.3f s\n", elapsed);
+    printf("mean path speed:      %.0f counts/s\n", length / elapsed);
+    printf("nominal speed:        %.0f counts/s\n", x_y_z_axes->profile.max_freq / x->steps_per_count());
+
+    x_y_z_axes->send({ mot_pap::type::HARD_STOP });
+    vTaskDelay(pdMS_TO_TICKS(10));
+}
+
+/**
+ * @brief   keeps the watchdog fed while the bench task is blocked sending
+ *          segments to the full planner
+ */
+void keep_alive_task(void *) {
+    while (true) {
+        rema::update_watchdog_timer();
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+void bench_task(void *) {
+    rema::control_enabled_set(true);
+    rema::stall_control = false; // no encoder feedback in this benchmark
+    x_y_z_axes->has_brakes = false;
+
+    scan();
+
+    exit(EXIT_SUCCESS);
+}
+} // namespace
+
+int main() {
+    sim::init();
+    debugInit();
+
+    rema::init_input_outputs();
+    xyz_axes_init();
+    encoders_pico_init();
+
+    sim::timer_attach(&x_y_z_axes->tmr, TIMER0_IRQHandler);
+    sim::dma_attach(&x_y_z_axes->tmr, &x_y_z_axes->dma, DMA1_Stream0_IRQHandler);
+    sim::timer_task_create();
+
+    xTaskCreate(keep_alive_task, "keep_alive", configMINIMAL_STACK_SIZE * 2, nullptr, tskIDLE_PRIORITY + 2, nullptr);
+    xTaskCreate(bench_task, "bench", configMINIMAL_STACK_SIZE * 2, nullptr, tskIDLE_PRIORITY + 1, nullptr);
+
+    vTaskStartScheduler();
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,212 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "debug.h"
+#include "encoders_pico.h"
+#include "mot_pap.h"
+#include "rema.h"
+#include "sim.h"
+#include "xyz_axes.h"
+
+extern "C" void TIMER0_IRQHandler(void);
+extern "C" void DMA1_Stream0_IRQHandler(void);
+
+namespace {
+constexpr int TRIALS = 10;
+constexpr int MAX_SETPOINT = 2000;
+constexpr int SETTLE_MS = 100;
+
+struct edge {
+    uint64_t ns;
+    uint32_t odr;
+};
+
+struct run {
+    uint32_t start_odr;
+    std::vector<edge> trace; // every change of the step port, from the start of the move
+    uint64_t irqs;           // step IRQs up to the end of the segment
+};
+
+run *tracing = nullptr;
+volatile uint32_t trace_ticks = UINT32_MAX;
+GPIO_TypeDef *const step_port = x_axis_traits::step::port();
+constexpr uint32_t step_masks[] = { x_axis_traits::step::mask, y_axis_traits::step::mask, z_axis_traits::step::mask };
+constexpr uint32_t step_pins = step_masks[0] | step_masks[1] | step_masks[2];
+
+void trace_step_port(GPIO_TypeDef *port, uint32_t odr, uint64_t ns) {
+    if (!tracing || port != step_port) {
+        return;
+    }
+
+    std::vector<edge> &trace = tracing->trace;
+    odr &= step_pins;
+    if (trace.empty() ? tracing->start_odr != odr : trace.back().odr != odr) {
+        trace.push_back({ ns, odr });
+        if (trace.size() == trace_ticks) {
+            tracing->irqs = sim::timer_stats_get().isr_calls;
+        }
+    }
+}
+
+/**
+ * @brief   moves from the origin to the setpoints with the steps output by
+ *          the ISR or by the DMA, and records the step port until the
+ *          leader has done all the ticks of the segment.
+ *          The segment is followed by another one in the same direction, so
+ *          it is not the last one of the path, which is corrected in closed
+ *          loop with the encoders
+ */
+run record(std::array<int, 3> setpoints, bool dma_steps, segment<3> &seg) {
+    run r = {};
+    x_y_z_axes->dma_steps = dma_steps;
+    for (mot_pap *axis : x_y_z_axes->axes) {
+        axis->set_position(0);
+    }
+
+    r.start_odr = step_port->ODR & step_pins;
+    r.trace.reserve(1 << 20);
+    trace_ticks = UINT32_MAX;
+    sim::timer_stats_reset();
+    tracing = &r;
+    uint32_t seq = x_y_z_axes->segment_seq;
+    x_y_z_axes->send({ mot_pap::type::MOVE, setpoints });
+    x_y_z_axes->send({ mot_pap::type::MOVE, { 2 * setpoints[0], 2 * setpoints[1], 2 * setpoints[2] } });
+    while (x_y_z_axes->segment_seq == seq) {
+        vTaskDelay(1);
+    }
+
+    seg = x_y_z_axes->planner.current();
+    trace_ticks = seg.ticks;
+    while (r.trace.size() < seg.ticks) {
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+    tracing = nullptr;
+
+    x_y_z_axes->hard_stop();
+    vTaskDelay(pdMS_TO_TICKS(SETTLE_MS));
+    r.trace.resize(seg.ticks);
+    return r;
+}
+
+/**
+ * @returns the worst distance, in half pulses, of any axis to the straight
+ *          line of the segment over the ticks of the leader
+ */
+double ideal_deviation(run const &r, segment<3> const &seg, std::array<uint32_t, 3> &half_pulses) {
+    double worst = 0;
+    half_pulses = {};
+    uint32_t odr = r.start_odr;
+    for (std::size_t tick = 0; tick < r.trace.size(); tick++) {
+        uint32_t toggled = r.trace[tick].odr ^ odr;
+        odr = r.trace[tick].odr;
+        for (std::size_t i = 0; i < 3; i++) {
+            if (toggled & step_masks[i]) {
+                half_pulses[i]++;
+            }
+            double ideal = static_cast<double>(tick + 1) * seg.delta[i] / seg.delta[seg.leader];
+            worst = std::max(worst, std::fabs(half_pulses[i] - ideal));
+        }
+    }
+    return worst;
+}
+
+/**
+ * @returns the number of ticks whose edges or length differ between runs
+ */
+uint32_t mismatches(run const &a, run const &b) {
+    uint32_t count = 0;
+    for (std::size_t tick = 1; tick < std::min(a.trace.size(), b.trace.size()); tick++) {
+        uint32_t toggled_a = a.trace[tick].odr ^ a.trace[tick - 1].odr;
+        uint32_t toggled_b = b.trace[tick].odr ^ b.trace[tick - 1].odr;
+        uint64_t length_a = a.trace[tick].ns - a.trace[tick - 1].ns;
+        uint64_t length_b = b.trace[tick].ns - b.trace[tick - 1].ns;
+        if (toggled_a != toggled_b || length_a != length_b) {
+            count++;
+        }
+    }
+    return count + (a.trace.size() != b.trace.size());
+}
+
+/**
+ * @brief   keeps the watchdog fed while the bench task is blocked
+ */
+void keep_alive_task(void *) {
+    while (true) {
+        rema::update_watchdog_timer();
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+void bench_task(void *) {
+    rema::control_enabled_set(true);
+    rema::stall_control = false; // no encoder feedback in this benchmark
+    x_y_z_axes->has_brakes = false;
+
+    uint64_t ticks = 0;
+    uint64_t irqs[2] = {};
+    uint32_t mismatched = 0;
+    uint32_t end_errors = 0;
+    double deviation = 0;
+
+    srand(1);
+    for (int trial = 0; trial < TRIALS; trial++) {
+        std::array<int, 3> setpoints;
+        for (int &setpoint : setpoints) {
+            setpoint = (rand() % (2 * MAX_SETPOINT)) - MAX_SETPOINT;
+        }
+
+        segment<3> seg;
+        run by_isr = record(setpoints, false, seg);
+        run by_dma = record(setpoints, true, seg);
+
+        for (run const *r : { &by_isr, &by_dma }) {
+            std::array<uint32_t, 3> half_pulses;
+            deviation = std::max(deviation, ideal_deviation(*r, seg, half_pulses));
+            for (std::size_t i = 0; i < 3; i++) {
+                end_errors += half_pulses[i] != x_y_z_axes->axes[i]->counts_to_half_pulses(seg.delta[i]);
+            }
+        }
+
+        mismatched += mismatches(by_isr, by_dma);
+        ticks += seg.ticks;
+        irqs[0] += by_isr.irqs;
+        irqs[1] += by_dma.irqs;
+    }
+
+    printf("moves:                         %d, %llu ticks\n", TRIALS, static_cast<unsigned long long>(ticks));
+    printf("max deviation from the line:   %.2f half pulses\n", deviation);
+    printf("axes off their end position:   %u\n", end_errors);
+    printf("DMA ticks different from ISR:  %u\n", mismatched);
+    printf("IRQs per tick, ISR:            %.4f\n", static_cast<double>(irqs[0]) / ticks);
+    printf("IRQs per tick, DMA:            %.4f (%d ticks per half schedule)\n", static_cast<double>(irqs[1]) / ticks, SCHEDULE_HALF);
+
+    exit(mismatched || end_errors || deviation > 0.5 + 1e-6 ? EXIT_FAILURE : EXIT_SUCCESS);
+}
+} // namespace
+
+int main() {
+    sim::init();
+    debugInit();
+
+    rema::init_input_outputs();
+    xyz_axes_init();
+    encoders_pico_init();
+
+    sim::timer_attach(&x_y_z_axes->tmr, TIMER0_IRQHandler);
+    sim::dma_attach(&x_y_z_axes->tmr, &x_y_z_axes->dma, DMA1_Stream0_IRQHandler);
+    sim::gpio_trace(trace_step_port);
+    sim::timer_task_create();
+
+    xTaskCreate(keep_alive_task, "keep_alive", configMINIMAL_STACK_SIZE * 2, nullptr, tskIDLE_PRIORITY + 2, nullptr);
+    xTaskCreate(bench_task, "bench", configMINIMAL_STACK_SIZE * 2, nullptr, tskIDLE_PRIORITY + 1, nullptr);
+
+    vTaskStartScheduler();
+    return EXIT_FAILURE;
+}
@@ -0,0 +1,192 @@
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "debug.h"
+#include "encoders_pico.h"
+#include "mot_pap.h"
+#include "rema.h"
+#include "sim.h"
+#include "tmr.h"
+#include "xyz_axes.h"
+
+extern "C" void TIMER0_IRQHandler(void);
+extern "C" void DMA1_Stream0_IRQHandler(void);
+
+namespace {
+constexpr int TRIALS = 10;
+constexpr int MAX_SETPOINT = 20000;
+constexpr int QUEUED_MOVES = 4;
+constexpr int SETTLE_MS = 500;
+
+enum class lane {
+    ISR,   // hard_stop_from_isr() from the packet interrupt
+    TASK,  // hard_stop() from the command task
+    QUEUE, // HARD_STOP message through send()
+};
+
+struct lane_stats {
+    const char *name;
+    int trials;
+    uint64_t latency_ns_sum;
+    uint64_t latency_ns_max;
+};
+
+class tmr rx_timer; // fires the packet arrival at an arbitrary virtual time
+TaskHandle_t command_task_handle = nullptr;
+volatile lane current_lane = lane::ISR;
+volatile uint64_t arrival_ns = 0;
+volatile bool was_moving_at_arrival = false;
+
+/**
+ * @brief   the packet interrupt: the fast lane stops the axes from here, the
+ *          others wake the command task up
+ */
+void rx_irq_handler() {
+    BaseType_t xHigherPriorityTaskWoken = pdFALSE;
+    rx_timer.stop();
+    arrival_ns = sim::now_ns();
+    was_moving_at_arrival = x_y_z_axes->tmr.is_started();
+
+    if (current_lane == lane::ISR) {
+        x_y_z_axes->hard_stop_from_isr(&xHigherPriorityTaskWoken);
+    }
+    vTaskNotifyGiveFromISR(command_task_handle, &xHigherPriorityTaskWoken);
+    portYIELD_FROM_ISR(xHigherPriorityTaskWoken);
+}
+
+template <typename... Axes> uint64_t last_step_ns() {
+    return std::max({ sim::gpio_last_rising_edge_ns(Axes::step::port(), Axes::step::mask)... });
+}
+
+bresenham_msg<3> random_msg(enum mot_pap::type type) {
+    bresenham_msg<3> msg;
+    msg.type = type;
+    for (int &setpoint : msg.setpoints) {
+        setpoint = (rand() % (2 * MAX_SETPOINT)) - MAX_SETPOINT;
+    }
+    return msg;
+}
+
+/**
+ * @brief   one stop under load: the axes are moving, the axis task is
+ *          blocked in move() releasing the brakes and there are MOVEs
+ *          queued behind it when the packet arrives
+ */
+void trial(lane l, lane_stats &stats) {
+    x_y_z_axes->send(random_msg(mot_pap::type::MOVE_JOYSTICK));
+    vTaskDelay(pdMS_TO_TICKS(rema::BRAKES_RELEASE_DELAY_MS + 100 + rand() % 200));
+
+    x_y_z_axes->send(random_msg(mot_pap::type::MOVE_JOYSTICK));
+    for (int i = 0; i < QUEUED_MOVES; i++) {
+        x_y_z_axes->send(random_msg(mot_pap::type::MOVE));
+    }
+
+    // Arrives anywhere in the first 150 ms of the brakes release
+    current_lane = l;
+    uint32_t clock_hz = rx_timer.get_clock_hz();
+    rx_timer.set_period(1 + static_cast<uint64_t>(rand() % 150000) * (clock_hz / 1000000));
+    rx_timer.start();
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+
+    switch (l) {
+    case lane::TASK:
+        x_y_z_axes->hard_stop();
+        break;
+
+    case lane::QUEUE:
+        x_y_z_axes->send({ mot_pap::type::HARD_STOP });
+        break;
+
+    case lane::ISR:
+    default:
+        break;
+    }
+
+    vTaskDelay(pdMS_TO_TICKS(SETTLE_MS));
+
+    if (was_moving_at_arrival) {
+        uint64_t last = last_step_ns<x_axis_traits, y_axis_traits, z_axis_traits>();
+        uint64_t latency = last > arrival_ns ? last - arrival_ns : 0;
+        stats.trials++;
+        stats.latency_ns_sum += latency;
+        stats.latency_ns_max = std::max(stats.latency_ns_max, latency);
+    }
+
+    // Leftovers of the slow lane
+    x_y_z_axes->hard_stop();
+    vTaskDelay(pdMS_TO_TICKS(rema::BRAKES_RELEASE_DELAY_MS + 100));
+}
+
+/**
+ * @brief   keeps the watchdog fed while the command task is blocked
+ */
+void keep_alive_task(void *) {
+    while (true) {
+        rema::update_watchdog_timer();
+        vTaskDelay(pdMS_TO_TICKS(10));
+    }
+}
+
+/**
+ * @brief   plays the command server: the only task that sends commands to
+ *          the axes
+ */
+void command_task(void *) {
+    rema::control_enabled_set(true);
+    rema::stall_control = false; // no encoder feedback in this benchmark
+    x_y_z_axes->has_brakes = true;
+    rema::brakes_mode = rema::brakes_mode_t::AUTO;
+
+    lane_stats stats[] = {
+        { "hard_stop_from_isr()", 0, 0, 0 },
+        { "hard_stop()", 0, 0, 0 },
+        { "send(HARD_STOP)", 0, 0, 0 },
+    };
+
+    srand(1);
+    for (int i = 0; i < TRIALS; i++) {
+        trial(lane::ISR, stats[0]);
+        trial(lane::TASK, stats[1]);
+        trial(lane::QUEUE, stats[2]);
+    }
+
+    printf("packet arrival to last step pulse, %d queued MOVEs, move() releasing the brakes\n", QUEUED_MOVES);
+    printf("%-22s %8s %14s %14s\n", "lane", "trials", "mean", "max");
+    for (lane_stats const &s : stats) {
+        printf("%-22s %8d %11.1f us %11.1f us\n",
+               s.name,
+               s.trials,
+               s.trials ? s.latency_ns_sum / 1e3 / s.trials : 0.0,
+               s.latency_ns_max / 1e3);
+    }
+    printf("task lanes include up to one RTOS tick (%u us) of virtual clock granularity\n",
+           static_cast<unsigned>(1000000 / configTICK_RATE_HZ));
+
+    exit(EXIT_SUCCESS);
+}
+} // namespace
+
+int main() {
+    sim::init();
+    debugInit();
+
+    rema::init_input_outputs();
+    xyz_axes_init();
+    encoders_pico_init();
+
+    sim::timer_attach(&x_y_z_axes->tmr, TIMER0_IRQHandler);
+    sim::dma_attach(&x_y_z_axes->tmr, &x_y_z_axes->dma, DMA1_Stream0_IRQHandler);
+    sim::timer_attach(&rx_timer, rx_irq_handler);
+    sim::timer_task_create();
+
+    xTaskCreate(keep_alive_task, "keep_alive", configMINIMAL_STACK_SIZE * 2, nullptr, tskIDLE_PRIORITY + 2, nullptr);
+    xTaskCreate(command_task, "command", configMINIMAL_STACK_SIZE * 2, nullptr, tskIDLE_PRIORITY + 1, &command_task_handle);
+
+    vTaskStartScheduler();
+    return EXIT_FAILURE;
+}
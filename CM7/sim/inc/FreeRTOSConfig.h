@@ -0,0 +1,54 @@
+#ifndef FREERTOS_CONFIG_H
+#define FREERTOS_CONFIG_H
+
+/*-----------------------------------------------------------
+ * FreeRTOS configuration for the Linux host simulation (POSIX port).
+ *
+ * Priorities, tick rate and heap size mirror CM7/Core/Inc/FreeRTOSConfig.h
+ * so that the motion core behaves as on the target. Stack sizes are in
+ * words of the host and have to be at least PTHREAD_STACK_MIN.
+ *----------------------------------------------------------*/
+
+#include <assert.h>
+#include <limits.h>
+#include <stdint.h>
+
+#define configUSE_PREEMPTION                     1
+#define configSUPPORT_STATIC_ALLOCATION          0
+#define configSUPPORT_DYNAMIC_ALLOCATION         1
+#define configUSE_IDLE_HOOK                      0
+#define configUSE_TICK_HOOK                      0
+#define configTICK_RATE_HZ                       ((TickType_t)1000)
+#define configMAX_PRIORITIES                     ( 7 )
+#define configMINIMAL_STACK_SIZE                 ((unsigned short)PTHREAD_STACK_MIN)
+#define configTOTAL_HEAP_SIZE                    ((size_t)15360)
+#define configMAX_TASK_NAME_LEN                  ( 16 )
+#define configTICK_TYPE_WIDTH_IN_BITS            TICK_TYPE_WIDTH_32_BITS
+#define configUSE_MUTEXES                        1
+#define configUSE_RECURSIVE_MUTEXES              1
+#define configUSE_COUNTING_SEMAPHORES            1
+#define configUSE_TASK_NOTIFICATIONS             1
+#define configQUEUE_REGISTRY_SIZE                8
+#define configUSE_PORT_OPTIMISED_TASK_SELECTION  0
+#define configUSE_TIMERS                         0
+#define configUSE_CO_ROUTINES                    0
+#define configUSE_TRACE_FACILITY                 0
+#define configCHECK_FOR_STACK_OVERFLOW           0
+
+#define INCLUDE_vTaskPrioritySet             1
+#define INCLUDE_uxTaskPriorityGet            1
+#define INCLUDE_vTaskDelete                  1
+#define INCLUDE_vTaskSuspend                 1
+#define INCLUDE_vTaskDelayUntil              1
+#define INCLUDE_vTaskDelay                   1
+#define INCLUDE_xTaskGetSchedulerState       1
+#define INCLUDE_xTaskGetCurrentTaskHandle    1
+#define INCLUDE_uxTaskGetStackHighWaterMark  1
+
+/* Used by the application to derive its interrupt priorities */
+#define configLIBRARY_LOWEST_INTERRUPT_PRIORITY      15
+#define configLIBRARY_MAX_SYSCALL_INTERRUPT_PRIORITY 5
+
+#define configASSERT(x) assert(x)
+
+#endif /* FREERTOS_CONFIG_H */
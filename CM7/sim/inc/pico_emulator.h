@@ -0,0 +1,86 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+#include "stm32h7xx_hal.h"
+
+#define PICO_EMULATOR_AXES 3
+
+class mot_pap;
+
+/**
+ * @brief   Raspberry Pi Pico encoders reader, emulated for the Linux host
+ *          build.
+ * @details Answers the SPI frames of encoders_pico with the register map of
+ *          quadrature_encoder_constants: an address frame, followed by a data
+ *          frame that writes the registers from the address on if it has
+ *          WRITE_MASK, or by a read frame that streams them.
+ *          Reading the base of the COUNTERS, TARGETS or DIRECTIONS blocks
+ *          streams the X, Y and Z registers of the block, reading LIMITS with
+ *          WRITE_MASK acknowledges the IRQ.
+ *
+ *          The counters integrate the rising edges of the step pins, in the
+ *          direction last written to the DIRECTIONS registers, as a motor
+ *          and an encoder with the resolutions and reversals of the axis
+ *          would. The targets flags are set while a counter is within the
+ *          position threshold of its target, and the hard limits ones while
+ *          it is out of the travel of the axis. The IRQ line is raised when
+ *          any of them is set, until it is acknowledged.
+ */
+class pico_emulator {
+  public:
+    struct emulator_stats {
+        uint32_t irqs;        // IRQ handler calls
+        uint64_t last_irq_ns; // virtual time of the last one
+        uint32_t transfers;   // SPI frames
+    };
+
+    /**
+     * @brief   emulates the encoder of an axis, counting the steps output on
+     *          the step pin of its traits
+     */
+    template <typename Traits> static void attach_axis(mot_pap const &axis) {
+        attach_axis(axis, Traits::step::port(), Traits::step::mask);
+    }
+
+    static void attach_axis(mot_pap const &axis, GPIO_TypeDef *step_port, uint16_t step_pin);
+
+    /**
+     * @brief   registers the handler of the IRQ line and starts following
+     *          the step pins from the virtual clock
+     */
+    static void irq_attach(void (*irq_handler)(void));
+
+    /**
+     * @brief   the travel of an axis, in raw counts. Out of it the hard limit
+     *          flag of that end is set: bit 2 * axis for the lower end, the
+     *          next one for the upper end
+     */
+    static void set_travel(char axis, int32_t min, int32_t max);
+
+    /**
+     * @brief   a stalled axis doesn't count the steps output to it, as if the
+     *          motor were blocked
+     */
+    static void set_stalled(char axis, bool stalled);
+
+    static int32_t counter(char axis);
+
+    /**
+     * @brief   the counter with the fraction of a count the steps output
+     *          since its last change moved the encoder
+     */
+    static double position(char axis);
+
+    static emulator_stats stats_get();
+
+    static void stats_reset();
+
+    static void spi_write(void const *buf, size_t len);
+
+    static void spi_read(void *buf, size_t len);
+
+  private:
+    static void poll();
+};
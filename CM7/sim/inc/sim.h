@@ -0,0 +1,103 @@
+#pragma once
+
+#include <cstdint>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "stm32h7xx_hal.h"
+
+#define SIM_TIMER_TASK_PRIORITY (configMAX_PRIORITIES - 1)
+#define SIM_MAX_TIMERS          4
+#define SIM_MAX_DEVICES         4
+
+/**
+ * @brief   simulated device for the Linux host build.
+ * @details Provides the GPIO peripheral model behind the HAL shim and a
+ *          virtual clock that fires the step timer interrupts. Virtual time
+ *          advances one FreeRTOS tick at a time; within a tick every timer
+ *          match is replayed in chronological order, so the ISRs see the
+ *          same sequence of events as on the target.
+ */
+class sim {
+  public:
+    struct timer_stats {
+        uint64_t isr_calls;
+        uint64_t isr_host_ns;     // host CPU time spent inside the IRQ handlers
+        uint64_t isr_host_ns_max; // worst case of a single IRQ handler call
+        uint64_t gpio_writes;     // BSRR writes, from the IRQ handlers or not
+    };
+
+    /**
+     * @brief   maps the peripheral register blocks at their target addresses
+     * @note    must be called before any GPIO is touched
+     */
+    static void init();
+
+    /**
+     * @brief   applies a BSRR write of a port to its ODR, as the GPIO
+     *          peripheral does, and counts the rising edges per pin
+     */
+    static void gpio_bsrr_write(GPIO_TypeDef *port, uint32_t bsrr);
+
+    static uint32_t gpio_rising_edges(GPIO_TypeDef *port, uint16_t pin);
+
+    /**
+     * @brief   virtual time of the last rising edge of a pin
+     */
+    static uint64_t gpio_last_rising_edge_ns(GPIO_TypeDef *port, uint16_t pin);
+
+    static void gpio_set_input(GPIO_TypeDef *port, uint16_t pin, bool state);
+
+    /**
+     * @brief   calls an observer on every BSRR write, with the port, its ODR
+     *          afterwards and the virtual time. nullptr removes it
+     */
+    static void gpio_trace(void (*observer)(GPIO_TypeDef *port, uint32_t odr, uint64_t ns));
+
+    /**
+     * @brief   registers a step timer so that the virtual clock calls its
+     *          IRQ handler at the period programmed with tmr::set_period().
+     *          The period is latched on every match, as the preload register
+     *          of the timer does
+     */
+    static void timer_attach(class tmr *tmr, void (*irq_handler)(void));
+
+    /**
+     * @brief   registers the DMA streams requested by an attached timer.
+     *          While the DMA is started, every update event moves one entry
+     *          of its step schedule to the port and the period, instead of
+     *          calling the timer IRQ handler, and its own handler is called
+     *          when each half of the schedule is done
+     */
+    static void dma_attach(class tmr *tmr, class step_dma *dma, void (*irq_handler)(void));
+
+    /**
+     * @brief   registers a device model that the virtual clock polls after
+     *          every timer match and at the end of every tick, so that it
+     *          follows the step pins as closely as the target hardware does
+     */
+    static void device_attach(void (*poll)(void));
+
+    /**
+     * @brief   creates the task that drives the virtual clock
+     */
+    static void timer_task_create();
+
+    static timer_stats timer_stats_get();
+
+    static void timer_stats_reset();
+
+    /**
+     * @brief   current virtual time
+     */
+    static uint64_t now_ns();
+
+    /**
+     * @brief   host monotonic clock, to measure CPU cost
+     */
+    static uint64_t host_ns();
+
+  private:
+    static void timer_task();
+};
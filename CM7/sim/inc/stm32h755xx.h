@@ -0,0 +1,124 @@
+#pragma once
+
+/**
+ * @file    stm32h755xx.h
+ * @brief   simulated subset of the STM32H755xx device header.
+ * @details Only the peripherals used by the motion core are described. The
+ *          peripheral register blocks live at their real addresses, mapped
+ *          into the host process by sim::init(), so code writing registers
+ *          directly behaves as on the target.
+ */
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+    EXTI0_IRQn = 6,
+    EXTI1_IRQn = 7,
+    EXTI2_IRQn = 8,
+    EXTI3_IRQn = 9,
+    EXTI4_IRQn = 10,
+    TIM2_IRQn = 28,
+    TIM3_IRQn = 29,
+    TIM4_IRQn = 30,
+    SPI1_IRQn = 35,
+    TIM5_IRQn = 50,
+    TIM6_DAC_IRQn = 54,
+    TIM7_IRQn = 55,
+} IRQn_Type;
+
+#ifdef __cplusplus
+/**
+ * @brief   BSRR applies a write to ODR at once, as the GPIO peripheral does
+ */
+struct sim_bsrr {
+    volatile uint32_t value;
+
+    void operator=(uint32_t bits) volatile;
+};
+#define SIM_BSRR_TYPE sim_bsrr
+#else
+#define SIM_BSRR_TYPE volatile uint32_t
+#endif
+
+typedef struct {
+    volatile uint32_t MODER;
+    volatile uint32_t OTYPER;
+    volatile uint32_t OSPEEDR;
+    volatile uint32_t PUPDR;
+    volatile uint32_t IDR;
+    volatile uint32_t ODR;
+    SIM_BSRR_TYPE BSRR;
+    volatile uint32_t LCKR;
+    volatile uint32_t AFR[2];
+} GPIO_TypeDef;
+
+#define PERIPH_BASE        (0x40000000UL)
+#define D3_AHB1PERIPH_BASE (PERIPH_BASE + 0x18020000UL)
+
+#define GPIOA_BASE (D3_AHB1PERIPH_BASE + 0x0000UL)
+#define GPIOB_BASE (D3_AHB1PERIPH_BASE + 0x0400UL)
+#define GPIOC_BASE (D3_AHB1PERIPH_BASE + 0x0800UL)
+#define GPIOD_BASE (D3_AHB1PERIPH_BASE + 0x0C00UL)
+#define GPIOE_BASE (D3_AHB1PERIPH_BASE + 0x1000UL)
+#define GPIOF_BASE (D3_AHB1PERIPH_BASE + 0x1400UL)
+#define GPIOG_BASE (D3_AHB1PERIPH_BASE + 0x1800UL)
+#define GPIOH_BASE (D3_AHB1PERIPH_BASE + 0x1C00UL)
+#define GPIOI_BASE (D3_AHB1PERIPH_BASE + 0x2000UL)
+#define GPIOJ_BASE (D3_AHB1PERIPH_BASE + 0x2400UL)
+#define GPIOK_BASE (D3_AHB1PERIPH_BASE + 0x2800UL)
+
+#define GPIOA ((GPIO_TypeDef *)GPIOA_BASE)
+#define GPIOB ((GPIO_TypeDef *)GPIOB_BASE)
+#define GPIOC ((GPIO_TypeDef *)GPIOC_BASE)
+#define GPIOD ((GPIO_TypeDef *)GPIOD_BASE)
+#define GPIOE ((GPIO_TypeDef *)GPIOE_BASE)
+#define GPIOF ((GPIO_TypeDef *)GPIOF_BASE)
+#define GPIOG ((GPIO_TypeDef *)GPIOG_BASE)
+#define GPIOH ((GPIO_TypeDef *)GPIOH_BASE)
+#define GPIOI ((GPIO_TypeDef *)GPIOI_BASE)
+#define GPIOJ ((GPIO_TypeDef *)GPIOJ_BASE)
+#define GPIOK ((GPIO_TypeDef *)GPIOK_BASE)
+
+#define SIM_GPIO_PORTS 11
+
+#define CoreDebug_DEMCR_TRCENA_Msk (1UL << 24)
+#define DWT_CTRL_CYCCNTENA_Msk     (1UL << 0)
+
+/**
+ * @brief   the host has no data cache to keep coherent with the DMA
+ */
+static inline void SCB_CleanDCache_by_Addr(volatile void *addr, int32_t dsize) {
+    (void)addr;
+    (void)dsize;
+}
+
+#ifdef __cplusplus
+}
+
+/**
+ * @brief   the DWT cycle counter reads the host clock, scaled to core cycles
+ *          at SystemCoreClock
+ */
+struct sim_cycle_counter {
+    operator uint32_t() const;
+};
+
+typedef struct {
+    volatile uint32_t CTRL;
+    sim_cycle_counter CYCCNT;
+} DWT_Type;
+
+typedef struct {
+    volatile uint32_t DEMCR;
+} CoreDebug_Type;
+
+extern DWT_Type sim_dwt;
+extern CoreDebug_Type sim_core_debug;
+
+#define DWT       (&sim_dwt)
+#define CoreDebug (&sim_core_debug)
+#endif
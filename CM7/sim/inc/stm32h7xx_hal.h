@@ -0,0 +1,62 @@
+#pragma once
+
+/**
+ * @file    stm32h7xx_hal.h
+ * @brief   simulated subset of the STM32H7 HAL used by the motion core.
+ * @details GPIO writes go through BSRR as in the real HAL, and are latched
+ *          into ODR by the simulated GPIO peripheral (see sim.h).
+ */
+
+#include <stdint.h>
+
+#include "stm32h755xx.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#define GPIO_PIN_0   ((uint16_t)0x0001)
+#define GPIO_PIN_1   ((uint16_t)0x0002)
+#define GPIO_PIN_2   ((uint16_t)0x0004)
+#define GPIO_PIN_3   ((uint16_t)0x0008)
+#define GPIO_PIN_4   ((uint16_t)0x0010)
+#define GPIO_PIN_5   ((uint16_t)0x0020)
+#define GPIO_PIN_6   ((uint16_t)0x0040)
+#define GPIO_PIN_7   ((uint16_t)0x0080)
+#define GPIO_PIN_8   ((uint16_t)0x0100)
+#define GPIO_PIN_9   ((uint16_t)0x0200)
+#define GPIO_PIN_10  ((uint16_t)0x0400)
+#define GPIO_PIN_11  ((uint16_t)0x0800)
+#define GPIO_PIN_12  ((uint16_t)0x1000)
+#define GPIO_PIN_13  ((uint16_t)0x2000)
+#define GPIO_PIN_14  ((uint16_t)0x4000)
+#define GPIO_PIN_15  ((uint16_t)0x8000)
+#define GPIO_PIN_All ((uint16_t)0xFFFF)
+
+typedef enum {
+    GPIO_PIN_RESET = 0U,
+    GPIO_PIN_SET
+} GPIO_PinState;
+
+extern uint32_t SystemCoreClock;
+
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState);
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin);
+
+void HAL_NVIC_SetPriority(IRQn_Type IRQn, uint32_t PreemptPriority, uint32_t SubPriority);
+
+void HAL_NVIC_EnableIRQ(IRQn_Type IRQn);
+
+void HAL_NVIC_DisableIRQ(IRQn_Type IRQn);
+
+void HAL_NVIC_ClearPendingIRQ(IRQn_Type IRQn);
+
+#define __HAL_GPIO_EXTI_CLEAR_IT(__EXTI_LINE__)   ((void)(__EXTI_LINE__))
+#define __HAL_GPIO_EXTI_CLEAR_FLAG(__EXTI_LINE__) ((void)(__EXTI_LINE__))
+
+#ifdef __cplusplus
+}
+#endif
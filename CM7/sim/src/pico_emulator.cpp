@@ -0,0 +1,289 @@
+#include "pico_emulator.h"
+
+#include <cstdlib>
+#include <cstring>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "encoders_pico.h"
+#include "mot_pap.h"
+#include "quadrature_encoder_constants.h"
+#include "sim.h"
+
+namespace {
+namespace regs = quadrature_encoder_constants;
+
+// The blocks of a Pico built with them, see encoders_pico
+#if defined(QUADRATURE_ENCODER_BLOCKS)
+constexpr int SNAPSHOT = regs::SNAPSHOT;
+constexpr int AXES_SETUP = regs::AXES_SETUP;
+#else
+constexpr int SNAPSHOT = -0x100; // never a register
+constexpr int AXES_SETUP = -0x100;
+#endif
+
+struct axis_model {
+    mot_pap const *axis;
+    GPIO_TypeDef *step_port;
+    uint16_t step_pin;
+    uint32_t edges; // rising edges of the step pin already counted
+    int64_t phase;  // fraction of a count, in 1 / motor_resolution
+    int32_t counter;
+    int32_t target;
+    int32_t direction; // as written by encoders_pico, 1 is CCW
+    int32_t travel_min;
+    int32_t travel_max;
+    bool stalled;
+};
+
+axis_model axes[PICO_EMULATOR_AXES] = {
+    { nullptr, nullptr, 0, 0, 0, 0, 0, 0, INT32_MIN, INT32_MAX, false },
+    { nullptr, nullptr, 0, 0, 0, 0, 0, 0, INT32_MIN, INT32_MAX, false },
+    { nullptr, nullptr, 0, 0, 0, 0, 0, 0, INT32_MIN, INT32_MAX, false },
+};
+
+int32_t threshold = 1;
+uint8_t hard = 0;
+uint8_t targets = 0;
+uint8_t address = 0;
+bool irq_line = false;      // raised until acknowledged
+bool irq_delivered = false; // the handler was called for this raise
+void (*irq_handler)(void) = nullptr;
+pico_emulator::emulator_stats stats;
+
+axis_model *model(char axis) {
+    int index = axis - 'X';
+    return (index >= 0 && index < PICO_EMULATOR_AXES) ? &axes[index] : nullptr;
+}
+
+/**
+ * @brief   counts the steps output since the last call, in the direction the
+ *          motor turns with the direction written by the firmware
+ */
+void integrate(axis_model &m) {
+    if (!m.axis) {
+        return;
+    }
+
+    uint32_t edges = sim::gpio_rising_edges(m.step_port, m.step_pin);
+    uint32_t steps = edges - m.edges;
+    m.edges = edges;
+    if (!steps || m.stalled) {
+        return;
+    }
+
+    bool forward = (m.direction != 0) != m.axis->reversed_direction;
+    bool up = forward != m.axis->reversed_encoder;
+    m.phase += (up ? 1 : -1) * static_cast<int64_t>(steps) * 4 * m.axis->encoder_resolution; // Full Quadrature Counting
+    m.counter += static_cast<int32_t>(m.phase / m.axis->motor_resolution);
+    m.phase %= m.axis->motor_resolution;
+}
+
+/**
+ * @brief   brings the counters up to date and raises the IRQ line if any
+ *          flag was set
+ */
+void update() {
+    uint8_t new_targets = 0;
+    uint8_t new_hard = 0;
+    for (int i = 0; i < PICO_EMULATOR_AXES; i++) {
+        axis_model &m = axes[i];
+        integrate(m);
+        if (std::abs(m.counter - m.target) < threshold) {
+            new_targets |= 1 << i;
+        }
+        if (m.counter < m.travel_min) {
+            new_hard |= 1 << (2 * i);
+        }
+        if (m.counter > m.travel_max) {
+            new_hard |= 1 << (2 * i + 1);
+        }
+    }
+
+    if ((new_targets & ~targets) || (new_hard & ~hard)) {
+        irq_line = true;
+    }
+    targets = new_targets;
+    hard = new_hard;
+}
+
+uint32_t register_word(uint8_t reg) {
+    uint32_t limits = static_cast<uint32_t>(hard) << 24 | static_cast<uint32_t>(targets) << 16;
+    for (int i = 0; i < PICO_EMULATOR_AXES; i++) {
+        if (reg == regs::COUNTERS + i + 1 || reg == SNAPSHOT + i) {
+            return axes[i].counter;
+        }
+        if (reg == regs::TARGETS + i + 1) {
+            return axes[i].target;
+        }
+        if (reg == regs::DIRECTIONS + i + 1) {
+            return axes[i].direction;
+        }
+    }
+
+    if (reg == regs::LIMITS || reg == SNAPSHOT + PICO_EMULATOR_AXES) {
+        return limits;
+    }
+    if (reg == regs::POS_THRESHOLDS) {
+        return threshold;
+    }
+    return 0;
+}
+
+void write_register(uint8_t reg, int32_t value) {
+    for (int i = 0; i < PICO_EMULATOR_AXES; i++) {
+        if (reg == regs::COUNTERS + i + 1) {
+            axes[i].counter = value;
+            axes[i].phase = 0;
+        }
+        if (reg == regs::TARGETS + i + 1 || reg == AXES_SETUP + i) {
+            axes[i].target = value;
+        }
+        if (reg == regs::DIRECTIONS + i + 1 || reg == AXES_SETUP + PICO_EMULATOR_AXES + i) {
+            axes[i].direction = value;
+        }
+    }
+
+    if (reg == regs::POS_THRESHOLDS || reg == AXES_SETUP + 2 * PICO_EMULATOR_AXES) {
+        threshold = value;
+    }
+}
+} // namespace
+
+void pico_emulator::attach_axis(mot_pap const &axis, GPIO_TypeDef *step_port, uint16_t step_pin) {
+    axis_model *m = model(axis.name);
+    configASSERT(m);
+    m->axis = &axis;
+    m->step_port = step_port;
+    m->step_pin = step_pin;
+    m->edges = sim::gpio_rising_edges(step_port, step_pin);
+    m->phase = 0;
+}
+
+void pico_emulator::irq_attach(void (*handler)(void)) {
+    configASSERT(!irq_handler);
+    irq_handler = handler;
+    sim::device_attach(poll);
+}
+
+void pico_emulator::set_travel(char axis, int32_t min, int32_t max) {
+    axis_model *m = model(axis);
+    configASSERT(m);
+    taskENTER_CRITICAL();
+    m->travel_min = min;
+    m->travel_max = max;
+    taskEXIT_CRITICAL();
+}
+
+void pico_emulator::set_stalled(char axis, bool stalled) {
+    axis_model *m = model(axis);
+    configASSERT(m);
+    taskENTER_CRITICAL();
+    integrate(*m);
+    m->stalled = stalled;
+    taskEXIT_CRITICAL();
+}
+
+int32_t pico_emulator::counter(char axis) {
+    axis_model *m = model(axis);
+    configASSERT(m);
+    taskENTER_CRITICAL();
+    integrate(*m);
+    int32_t counter = m->counter;
+    taskEXIT_CRITICAL();
+    return counter;
+}
+
+double pico_emulator::position(char axis) {
+    axis_model *m = model(axis);
+    configASSERT(m);
+    taskENTER_CRITICAL();
+    integrate(*m);
+    double position = m->counter + static_cast<double>(m->phase) / m->axis->motor_resolution;
+    taskEXIT_CRITICAL();
+    return position;
+}
+
+pico_emulator::emulator_stats pico_emulator::stats_get() {
+    return stats;
+}
+
+void pico_emulator::stats_reset() {
+    memset(&stats, 0, sizeof(stats));
+}
+
+/**
+ * @brief   a frame of one byte is an address, a longer one after an address
+ *          with WRITE_MASK writes the registers from it on, big endian
+ */
+void pico_emulator::spi_write(void const *buf, size_t len) {
+    uint8_t const *tx = static_cast<uint8_t const *>(buf);
+
+    taskENTER_CRITICAL();
+    stats.transfers++;
+    if (len == 1) {
+        address = tx[0];
+    } else if (address & regs::WRITE_MASK) {
+        update();
+        uint8_t reg = address & ~regs::WRITE_MASK;
+        for (size_t i = 0; i + 4 <= len; i += 4) {
+            write_register(reg + i / 4, static_cast<int32_t>(tx[i] << 24 | tx[i + 1] << 16 | tx[i + 2] << 8 | tx[i + 3] << 0));
+        }
+        update();
+    }
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief   streams the registers from the last address on, big endian
+ */
+void pico_emulator::spi_read(void *buf, size_t len) {
+    uint8_t *rx = static_cast<uint8_t *>(buf);
+
+    taskENTER_CRITICAL();
+    stats.transfers++;
+    update();
+
+    uint8_t reg = address & ~regs::WRITE_MASK;
+    if (reg == regs::COUNTERS || reg == regs::TARGETS || reg == regs::DIRECTIONS) {
+        reg++; // the X register of the block
+    }
+
+    for (size_t i = 0; i < len; i++) {
+        uint32_t word = register_word(reg + i / 4);
+        rx[i] = static_cast<uint8_t>(word >> (24 - 8 * (i % 4)));
+    }
+
+    if (address == (regs::LIMITS | regs::WRITE_MASK)) {
+        irq_line = false;
+        irq_delivered = false;
+    }
+    taskEXIT_CRITICAL();
+}
+
+/**
+ * @brief   follows the step pins and calls the IRQ handler when the line
+ *          rises, as the pin interrupt of the target does
+ */
+void pico_emulator::poll() {
+    taskENTER_CRITICAL();
+    update();
+    bool deliver = irq_line && !irq_delivered;
+    irq_delivered |= deliver;
+    taskEXIT_CRITICAL();
+
+    if (deliver && irq_handler) {
+        stats.irqs++;
+        stats.last_irq_ns = sim::now_ns();
+        irq_handler();
+    }
+}
+
+extern "C" void sim_spi_write(void const *buf, size_t len) {
+    pico_emulator::spi_write(buf, len);
+}
+
+extern "C" void sim_spi_read(void *buf, size_t len) {
+    pico_emulator::spi_read(buf, len);
+}
@@ -0,0 +1,249 @@
+#include "sim.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <sys/mman.h>
+#include <time.h>
+
+#include "FreeRTOS.h"
+#include "task.h"
+
+#include "step_dma.h"
+#include "tmr.h"
+
+namespace {
+constexpr uint64_t NS_PER_TICK = 1000000000ULL / configTICK_RATE_HZ;
+constexpr uintptr_t GPIO_PORT_STRIDE = GPIOB_BASE - GPIOA_BASE;
+
+struct timer_channel {
+    class tmr *tmr;
+    void (*irq_handler)(void);
+    class step_dma *dma;
+    void (*dma_irq_handler)(void);
+    bool running;
+    uint64_t next_match_ns;
+};
+
+timer_channel timer_channels[SIM_MAX_TIMERS];
+int timer_channels_count = 0;
+void (*device_polls[SIM_MAX_DEVICES])(void);
+int device_polls_count = 0;
+sim::timer_stats stats;
+volatile uint64_t virtual_ns = 0;
+
+uint32_t rising_edges[SIM_GPIO_PORTS][16];
+uint64_t last_rising_edge_ns[SIM_GPIO_PORTS][16];
+void (*gpio_observer)(GPIO_TypeDef *port, uint32_t odr, uint64_t ns) = nullptr;
+
+uint64_t period_ns(class tmr *tmr, uint32_t period) {
+    uint64_t clock_hz = tmr->get_clock_hz();
+    return (static_cast<uint64_t>(period) * 1000000000ULL + clock_hz / 2) / clock_hz;
+}
+
+int port_index(GPIO_TypeDef *port) {
+    return static_cast<int>((reinterpret_cast<uintptr_t>(port) - GPIOA_BASE) / GPIO_PORT_STRIDE);
+}
+
+/**
+ * @brief   moves the next entry of the step schedule, as the DMA streams do
+ *          on an update event
+ * @returns true if a half of the schedule is done and the DMA interrupts
+ */
+bool dma_request(class tmr &tmr, class step_dma &dma) {
+    uint32_t entry = dma.next;
+    dma.port->BSRR = dma.bsrr[entry];
+    tmr.set_period(dma.periods[entry]);
+
+    dma.next = (entry + 1) % dma.count;
+    if (dma.next == dma.count / 2) {
+        dma.flags |= step_dma::HALF_TRANSFER;
+        return true;
+    }
+    if (dma.next == 0) {
+        dma.flags |= step_dma::TRANSFER_COMPLETE;
+        return true;
+    }
+    return false;
+}
+
+void poll_devices() {
+    for (int i = 0; i < device_polls_count; i++) {
+        device_polls[i]();
+    }
+}
+
+void *map_fixed(uintptr_t base, size_t size) {
+    void *addr = mmap(reinterpret_cast<void *>(base),
+                      size,
+                      PROT_READ | PROT_WRITE,
+                      MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED_NOREPLACE,
+                      -1,
+                      0);
+    if (addr != reinterpret_cast<void *>(base)) {
+        fprintf(stderr, "sim: unable to map peripherals at %p\n", reinterpret_cast<void *>(base));
+        exit(EXIT_FAILURE);
+    }
+    return addr;
+}
+} // namespace
+
+void sim::init() {
+    map_fixed(GPIOA_BASE, SIM_GPIO_PORTS * GPIO_PORT_STRIDE);
+}
+
+void sim::gpio_bsrr_write(GPIO_TypeDef *port, uint32_t bsrr) {
+    stats.gpio_writes++;
+
+    uint32_t odr = port->ODR;
+    uint32_t set = bsrr & 0xFFFF;
+    uint32_t reset = (bsrr >> 16) & ~set; // BSx has priority over BRx
+    uint32_t new_odr = (odr & ~reset) | set;
+
+    uint32_t rising = new_odr & ~odr;
+    int index = port_index(port);
+    while (rising) {
+        int pin = __builtin_ctz(rising);
+        rising_edges[index][pin]++;
+        last_rising_edge_ns[index][pin] = virtual_ns;
+        rising &= rising - 1;
+    }
+
+    port->ODR = new_odr;
+    port->IDR = new_odr;
+
+    if (gpio_observer) {
+        gpio_observer(port, new_odr, virtual_ns);
+    }
+}
+
+uint32_t sim::gpio_rising_edges(GPIO_TypeDef *port, uint16_t pin) {
+    return rising_edges[port_index(port)][__builtin_ctz(pin)];
+}
+
+uint64_t sim::gpio_last_rising_edge_ns(GPIO_TypeDef *port, uint16_t pin) {
+    return last_rising_edge_ns[port_index(port)][__builtin_ctz(pin)];
+}
+
+void sim::gpio_set_input(GPIO_TypeDef *port, uint16_t pin, bool state) {
+    if (state) {
+        port->IDR |= pin;
+    } else {
+        port->IDR &= ~static_cast<uint32_t>(pin);
+    }
+}
+
+void sim::gpio_trace(void (*observer)(GPIO_TypeDef *port, uint32_t odr, uint64_t ns)) {
+    gpio_observer = observer;
+}
+
+void sim::timer_attach(class tmr *tmr, void (*irq_handler)(void)) {
+    configASSERT(timer_channels_count < SIM_MAX_TIMERS);
+    timer_channels[timer_channels_count++] = { tmr, irq_handler, nullptr, nullptr, false, 0 };
+}
+
+void sim::dma_attach(class tmr *tmr, class step_dma *dma, void (*irq_handler)(void)) {
+    for (int i = 0; i < timer_channels_count; i++) {
+        if (timer_channels[i].tmr == tmr) {
+            timer_channels[i].dma = dma;
+            timer_channels[i].dma_irq_handler = irq_handler;
+            return;
+        }
+    }
+    configASSERT(false); // the timer must be attached first
+}
+
+void sim::device_attach(void (*poll)(void)) {
+    configASSERT(device_polls_count < SIM_MAX_DEVICES);
+    device_polls[device_polls_count++] = poll;
+}
+
+void sim::timer_task_create() {
+    xTaskCreate([](void *) { sim::timer_task(); }, "sim_timer", configMINIMAL_STACK_SIZE * 2, nullptr, SIM_TIMER_TASK_PRIORITY, nullptr);
+}
+
+/**
+ * @brief   virtual clock. Every tick replays, in chronological order, all the
+ *          timer matches that fall inside that tick
+ */
+void sim::timer_task() {
+    TickType_t last_wake = xTaskGetTickCount();
+    uint64_t tick_end_ns = static_cast<uint64_t>(last_wake) * NS_PER_TICK;
+
+    while (true) {
+        vTaskDelayUntil(&last_wake, 1);
+        tick_end_ns += NS_PER_TICK;
+
+        while (true) {
+            timer_channel *next = nullptr;
+            for (int i = 0; i < timer_channels_count; i++) {
+                timer_channel &ch = timer_channels[i];
+                uint32_t period = ch.tmr->get_period();
+                if (!ch.tmr->is_started() || period == 0) {
+                    ch.running = false;
+                    continue;
+                }
+
+                if (!ch.running) {
+                    ch.running = true;
+                    ch.next_match_ns = virtual_ns + period_ns(ch.tmr, period);
+                }
+
+                if (ch.next_match_ns <= tick_end_ns && (!next || ch.next_match_ns < next->next_match_ns)) {
+                    next = &ch;
+                }
+            }
+
+            if (!next) {
+                break;
+            }
+
+            // The preloaded period is latched on the match, before the
+            // handler writes the one for the following match
+            virtual_ns = next->next_match_ns;
+            next->next_match_ns += period_ns(next->tmr, next->tmr->get_period());
+
+            void (*irq_handler)(void) = next->irq_handler;
+            if (next->dma && next->dma->is_started()) {
+                irq_handler = dma_request(*next->tmr, *next->dma) ? next->dma_irq_handler : nullptr;
+            }
+
+            if (!irq_handler) {
+                poll_devices();
+                continue;
+            }
+
+            uint64_t start = host_ns();
+            irq_handler();
+            uint64_t elapsed = host_ns() - start;
+
+            stats.isr_calls++;
+            stats.isr_host_ns += elapsed;
+            if (elapsed > stats.isr_host_ns_max) {
+                stats.isr_host_ns_max = elapsed;
+            }
+            poll_devices();
+        }
+
+        virtual_ns = tick_end_ns;
+        poll_devices();
+    }
+}
+
+sim::timer_stats sim::timer_stats_get() {
+    return stats;
+}
+
+void sim::timer_stats_reset() {
+    memset(&stats, 0, sizeof(stats));
+}
+
+uint64_t sim::now_ns() {
+    return virtual_ns;
+}
+
+uint64_t sim::host_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return static_cast<uint64_t>(ts.tv_sec) * 1000000000ULL + ts.tv_nsec;
+}
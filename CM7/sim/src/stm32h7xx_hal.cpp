@@ -0,0 +1,62 @@
+#include "stm32h7xx_hal.h"
+
+#include <cstddef>
+
+#include "sim.h"
+
+uint32_t SystemCoreClock = 480000000;
+
+DWT_Type sim_dwt;
+CoreDebug_Type sim_core_debug;
+
+sim_cycle_counter::operator uint32_t() const {
+    return static_cast<uint32_t>(sim::host_ns() * (SystemCoreClock / 1000000) / 1000);
+}
+
+/**
+ * @brief   the virtual clock the axes move on, scaled to core cycles at
+ *          SystemCoreClock
+ */
+extern "C" uint32_t sim_virtual_cycles(void) {
+    return static_cast<uint32_t>(sim::now_ns() * (SystemCoreClock / 1000000) / 1000);
+}
+
+void sim_bsrr::operator=(uint32_t bits) volatile {
+    auto *port = reinterpret_cast<GPIO_TypeDef *>(reinterpret_cast<uintptr_t>(this) - offsetof(GPIO_TypeDef, BSRR));
+    sim::gpio_bsrr_write(port, bits);
+}
+
+/**
+ * @brief   writes a pin through BSRR, as HAL_GPIO_WritePin() does
+ */
+void HAL_GPIO_WritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState) {
+    if (PinState != GPIO_PIN_RESET) {
+        GPIOx->BSRR = GPIO_Pin;
+    } else {
+        GPIOx->BSRR = static_cast<uint32_t>(GPIO_Pin) << 16;
+    }
+}
+
+GPIO_PinState HAL_GPIO_ReadPin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+    return (GPIOx->IDR & GPIO_Pin) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+/**
+ * @brief   toggles a pin with a single BSRR write, as HAL_GPIO_TogglePin() does
+ */
+void HAL_GPIO_TogglePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin) {
+    uint32_t odrreg = GPIOx->ODR;
+    GPIOx->BSRR = ((odrreg & GPIO_Pin) << 16) | (~odrreg & GPIO_Pin);
+}
+
+void HAL_NVIC_SetPriority([[maybe_unused]] IRQn_Type IRQn, [[maybe_unused]] uint32_t PreemptPriority, [[maybe_unused]] uint32_t SubPriority) {
+}
+
+void HAL_NVIC_EnableIRQ([[maybe_unused]] IRQn_Type IRQn) {
+}
+
+void HAL_NVIC_DisableIRQ([[maybe_unused]] IRQn_Type IRQn) {
+}
+
+void HAL_NVIC_ClearPendingIRQ([[maybe_unused]] IRQn_Type IRQn) {
+}